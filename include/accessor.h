@@ -0,0 +1,60 @@
+#ifndef TENSOR_ACCESSOR_H
+#define TENSOR_ACCESSOR_H
+
+#include "shape.h"
+
+#include <array>
+#include <type_traits>
+#include <utility>
+
+namespace st {
+    // Unchecked element access for hand written loops: a typed pointer and
+    // Rank sizes and strides, so that a(i, j) is plain pointer arithmetic.
+    // Get one from Tensor::accessor<T, Rank>(), which checks dtype and rank
+    // once. It must not outlive the tensor's storage, and like any raw
+    // pointer it is not tracked by copy-on-write.
+    template<typename T, index_t Rank>
+    class TensorAccessor {
+        static_assert(Rank > 0, "TensorAccessor needs at least one dimension");
+    public:
+        TensorAccessor(T* data, const Shape& size, const IndexArray& stride) : _data(data) {
+            for (index_t d = 0; d < Rank; ++d) {
+                _size[d] = size[d];
+                _stride[d] = stride[d];
+            }
+        }
+        TensorAccessor(T* data, const index_t* size, const index_t* stride) : _data(data) {
+            for (index_t d = 0; d < Rank; ++d) {
+                _size[d] = size[d];
+                _stride[d] = stride[d];
+            }
+        }
+
+        template<typename... I>
+            requires (sizeof...(I) == Rank && (std::is_integral_v<I> && ...))
+        T& operator()(I... idx) const {
+            return at(std::index_sequence_for<I...>{}, idx...);
+        }
+        // the sub-accessor at index i of the first dimension
+        TensorAccessor<T, Rank-1> operator[](index_t i) const requires (Rank > 1) {
+            return TensorAccessor<T, Rank-1>(_data + static_cast<stride_t>(i*_stride[0]), _size.data()+1, _stride.data()+1);
+        }
+        T& operator[](index_t i) const requires (Rank == 1) { return _data[static_cast<stride_t>(i*_stride[0])]; }
+
+        [[nodiscard]] index_t size(index_t dim) const { return _size[dim]; }
+        [[nodiscard]] index_t stride(index_t dim) const { return _stride[dim]; }
+        [[nodiscard]] T* data() const { return _data; }
+
+    private:
+        template<std::size_t... D, typename... I>
+        T& at(std::index_sequence<D...>, I... idx) const {
+            return _data[static_cast<stride_t>(((static_cast<index_t>(idx) * _stride[D]) + ...))];
+        }
+
+        T* _data;
+        std::array<index_t, Rank> _size;
+        std::array<index_t, Rank> _stride;
+    };
+} // st
+
+#endif //TENSOR_ACCESSOR_H
@@ -4,12 +4,24 @@
 // basic allocate
 
 #include <cstdlib>
+#include <cstddef>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <iostream>
+#include <mutex>
 
 namespace st {
-    typedef unsigned int index_t;
+    // element counts, byte sizes, strides and offsets; 64 bits wide so that
+    // storages past 4 GiB work. Kernels walking a tensor whose offsets fit in
+    // 32 bits do their index arithmetic in index32_t instead.
+    typedef std::size_t index_t;
+    typedef uint32_t index32_t;
+    // A negative stride (a reversed view) is kept in index_t as its two's
+    // complement, so index arithmetic simply wraps around; read it through
+    // stride_t wherever its sign matters.
+    typedef std::ptrdiff_t stride_t;
+    static_assert(sizeof(index_t) == 8, "index_t must be 64 bits wide");
     class Alloc {
     public:
         class trivial_delete_handler {
@@ -82,6 +94,7 @@ namespace st {
             void operator()(void* ptr) { std::free(ptr); }
         };
         std::multimap<index_t, std::unique_ptr<void, free_deleter>> cache_;
+        std::mutex mutex_; // tensors may be made and released on loader threads
     };
 } // SimpleTensor
 
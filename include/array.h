@@ -55,7 +55,7 @@ namespace st {
             return d_ptr.get()[idx];
         }
 
-        int size() const { return this->size_; }
+        index_t size() const { return this->size_; }
         void memset(int value) const { std::memset(d_ptr.get(), value, size_*sizeof(DType));}
         void fill(DType value) const { std::fill_n(d_ptr.get(), size_, value); }
 
@@ -0,0 +1,32 @@
+#ifndef TENSOR_CPU_H
+#define TENSOR_CPU_H
+
+// Instruction sets the vector kernels are compiled for. Every kernel is
+// built for each of them with target attributes, and picked at run time by
+// what the CPU supports, so no -m flags are needed.
+
+#include "allocator.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define ST_X86_DISPATCH 1
+#endif
+
+namespace st {
+    namespace cpu {
+        // each level includes the ones before it
+        enum class Isa {
+            Baseline,  // portable code only
+            AVX2,      // AVX2, FMA and F16C
+            AVX512,    // AVX-512 F and BW
+            AVX512VNNI
+        };
+
+        // the best level this CPU supports, capped by set_max_isa()
+        Isa isa();
+        // caps the kernels used from now on, e.g. at Baseline to compare
+        // the vector paths against the portable one
+        void set_max_isa(Isa isa);
+    } // cpu
+} // st
+
+#endif //TENSOR_CPU_H
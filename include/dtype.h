@@ -0,0 +1,180 @@
+#ifndef TENSOR_DTYPE_H
+#define TENSOR_DTYPE_H
+
+// element types of a storage
+
+#include "allocator.h"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <algorithm>
+
+namespace st {
+    typedef double data_t; // expressions are evaluated in data_t whatever the storage type
+
+    // ordered so that promotion between two types of the same kind picks the later one
+    enum class DType : unsigned char { Int8, UInt8, Int32, Int64, BFloat16, Float16, Float32, Float64 };
+
+    namespace detail {
+        inline uint32_t float_bits(float value) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+        inline float bits_float(uint32_t bits) {
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+    } // detail
+
+    // 16-bit floating types, stored as raw bits and converted through float
+    // with round to nearest even
+    struct bfloat16 {
+        uint16_t bits;
+        bfloat16() = default;
+        explicit bfloat16(float value) {
+            uint32_t u = detail::float_bits(value);
+            if ((u & 0x7fffffffu) > 0x7f800000u) bits = (u >> 16) | 0x40; // keep nan quiet
+            else bits = (u + 0x7fffu + ((u >> 16) & 1)) >> 16;
+        }
+        operator float() const { return detail::bits_float((uint32_t)bits << 16); }
+    };
+
+    struct float16 {
+        uint16_t bits;
+        float16() = default;
+        explicit float16(float value) {
+            uint32_t u = detail::float_bits(value);
+            uint32_t sign = (u >> 16) & 0x8000;
+            u &= 0x7fffffffu;
+            if (u >= (143u << 23)) { // at least 2^16: inf or nan
+                bits = u > 0x7f800000u ? 0x7e00 : 0x7c00;
+            } else if (u < (113u << 23)) { // below 2^-14: subnormal, let the fpu round
+                bits = detail::float_bits(detail::bits_float(u) + 0.5f) - 0x3f000000u;
+            } else {
+                u += 0xc8000fffu + ((u >> 13) & 1); // rebias the exponent and round
+                bits = u >> 13;
+            }
+            bits |= sign;
+        }
+        operator float() const {
+            uint32_t u = (uint32_t)(bits & 0x7fff) << 13;
+            uint32_t exp = u & (0x7c00u << 13);
+            u += (127 - 15) << 23;
+            if (exp == (0x7c00u << 13)) { // inf or nan
+                u += (128 - 16) << 23;
+            } else if (exp == 0) { // zero or subnormal
+                u += 1 << 23;
+                u = detail::float_bits(detail::bits_float(u) - detail::bits_float(113u << 23));
+            }
+            return detail::bits_float(u | (uint32_t)(bits & 0x8000) << 16);
+        }
+    };
+
+    index_t dtype_size(DType dtype);
+    const char* dtype_name(DType dtype);
+    bool is_floating(DType dtype);
+    // int with int gives the wider int (int8 with uint8 gives int32), float
+    // with float the wider float (bfloat16 with float16 gives float32) and
+    // int with float the float
+    DType promote_types(DType lhs, DType rhs);
+
+    template<typename T> struct dtype_of;
+    template<> struct dtype_of<int8_t> { static constexpr DType value = DType::Int8; };
+    template<> struct dtype_of<uint8_t> { static constexpr DType value = DType::UInt8; };
+    template<> struct dtype_of<int32_t> { static constexpr DType value = DType::Int32; };
+    template<> struct dtype_of<int64_t> { static constexpr DType value = DType::Int64; };
+    template<> struct dtype_of<bfloat16> { static constexpr DType value = DType::BFloat16; };
+    template<> struct dtype_of<float16> { static constexpr DType value = DType::Float16; };
+    template<> struct dtype_of<float> { static constexpr DType value = DType::Float32; };
+    template<> struct dtype_of<double> { static constexpr DType value = DType::Float64; };
+
+    // calls f.template operator()<T>() with T the element type of dtype
+    template<typename F>
+    decltype(auto) dispatch(DType dtype, F&& f) {
+        switch (dtype) {
+            case DType::Int8: return f.template operator()<int8_t>();
+            case DType::UInt8: return f.template operator()<uint8_t>();
+            case DType::Int32: return f.template operator()<int32_t>();
+            case DType::Int64: return f.template operator()<int64_t>();
+            case DType::BFloat16: return f.template operator()<bfloat16>();
+            case DType::Float16: return f.template operator()<float16>();
+            case DType::Float32: return f.template operator()<float>();
+            default: return f.template operator()<double>();
+        }
+    }
+
+    // array conversions between the 16-bit types and float, using F16C for
+    // float16 where the CPU has it
+    void convert(const bfloat16* src, float* dst, index_t n);
+    void convert(const float* src, bfloat16* dst, index_t n);
+    void convert(const float16* src, float* dst, index_t n);
+    void convert(const float* src, float16* dst, index_t n);
+
+    // Elements are evaluated as data_t, which holds integers exactly only up
+    // to 2^53 in magnitude. Loading or storing an int64 outside of that range
+    // throws instead of rounding it; moving elements without evaluating them
+    // (contiguous(), cat(), save/load) keeps the full range.
+    constexpr int64_t kMaxExactInt64 = int64_t(1) << 53;
+    [[noreturn]] void inexact_int64(data_t value);
+
+    template<typename T>
+    data_t to_data(T value) {
+        if constexpr (std::is_same_v<T, int64_t>)
+            if (value > kMaxExactInt64 || value < -kMaxExactInt64) inexact_int64((data_t)value);
+        return static_cast<data_t>(value);
+    }
+    template<typename T>
+    T from_data(data_t value) {
+        if constexpr (std::is_same_v<T, int64_t>)
+            if (!(value >= -kMaxExactInt64 && value <= kMaxExactInt64)) inexact_int64(value);
+        return static_cast<T>(value);
+    }
+
+    // n elements between a buffer of T and a data_t buffer
+    template<typename T>
+    void load_block(const T* src, data_t* dst, index_t n) {
+        if constexpr (std::is_same_v<T, bfloat16> || std::is_same_v<T, float16>) {
+            float buf[256];
+            for (index_t start = 0; start < n; start += 256) {
+                index_t m = std::min<index_t>(256, n-start);
+                convert(src+start, buf, m);
+                for (index_t i = 0; i < m; ++i)
+                    dst[start+i] = buf[i];
+            }
+        } else {
+            for (index_t i = 0; i < n; ++i)
+                dst[i] = to_data(src[i]);
+        }
+    }
+    template<typename T>
+    void store_block(const data_t* src, T* dst, index_t n) {
+        if constexpr (std::is_same_v<T, bfloat16> || std::is_same_v<T, float16>) {
+            float buf[256];
+            for (index_t start = 0; start < n; start += 256) {
+                index_t m = std::min<index_t>(256, n-start);
+                for (index_t i = 0; i < m; ++i)
+                    buf[i] = (float)src[start+i];
+                convert(buf, dst+start, m);
+            }
+        } else {
+            for (index_t i = 0; i < n; ++i)
+                dst[i] = from_data<T>(src[i]);
+        }
+    }
+
+    inline data_t load(const void* ptr, DType dtype, index_t idx) {
+        return dispatch(dtype, [&]<typename T>() {
+            return to_data(static_cast<const T*>(ptr)[idx]);
+        });
+    }
+    inline void store(void* ptr, DType dtype, index_t idx, data_t value) {
+        dispatch(dtype, [&]<typename T>() {
+            static_cast<T*>(ptr)[idx] = from_data<T>(value);
+        });
+    }
+} // st
+
+#endif //TENSOR_DTYPE_H
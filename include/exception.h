@@ -43,12 +43,12 @@ namespace st {
 	#define CHECK_EXP_SAME_SHAPE(e1_, e2_) do { \
     auto& e1 = (e1_);  \
     auto& e2 = (e2_);  \
-    CHECK_EQUAL(e1.ndim(), e2.ndim(),  \
-        "Expect the same dimensions, but got %dD and %dD",  \
-        e1.ndim(), e2.ndim());  \
-    for(index_t i = 0; i < e1.ndim(); ++i) \
+    CHECK_EQUAL(e1.n_dim(), e2.n_dim(),  \
+        "Expect the same dimensions, but got %zuD and %zuD",  \
+        e1.n_dim(), e2.n_dim());  \
+    for(index_t i = 0; i < e1.n_dim(); ++i) \
         CHECK_EQUAL(e1.size(i), e2.size(i),  \
-            "Expect the same size on the %d dimension, but got %d and %d.",  \
+            "Expect the same size on the %zu dimension, but got %zu and %zu.",  \
             i, e1.size(i), e2.size(i));  \
 	} while(0)
     #define CHECK_EXP_BROADCAST(e1_, e2_) do { \
@@ -58,7 +58,7 @@ namespace st {
     int j = e2->n_dim()-1;                   \
     for (; i >= 0 && j >= 0; --i, --j) {   \
         CHECK_TRUE(e1->size(i) == e2->size(j) || e1->size(i) == 1 || e2->size(j) == 1, \
-            "Broadcast error with %d in tensor a but %d in tensor b.", e1->size(i), e2->size(j) \
+            "Broadcast error with %zu in tensor a but %zu in tensor b.", e1->size(i), e2->size(j) \
         );                                     \
     }                                      \
     } while(0);
@@ -2,8 +2,43 @@
 #define TENSOR_EXP_H
 
 #include "storage.h"
+#include "shape.h"
+
+#include <algorithm>
+#include <type_traits>
 
 namespace st {
+    class TensorImpl;
+
+    // Elementwise expressions whose leaves are all contiguous with the shape of
+    // the destination (or single elements) are evaluated block by block over the
+    // flat index instead of per element: eval_block(start, n, buf) returns
+    // a pointer to the n results from flat index start, either into buf or
+    // straight into the storage of a leaf.
+    //
+    // dtype() is the type the result is stored in when the expression is
+    // materialized: the promotion of its operands, or at least Float64 for
+    // ops such as division that always produce floating values. Comparisons
+    // produce masks, stored as UInt8 zeros and ones.
+    //
+    // overlaps(dst, elementwise) tells whether evaluating the expression while
+    // writing dst in order may read an element of dst after it was overwritten,
+    // in which case the assignment has to go through a temporary.
+    constexpr index_t BLOCK_SIZE = 256;
+
+    template<typename Op>
+    concept BinaryMap = requires(data_t lhs, data_t rhs) { Op::apply(lhs, rhs); };
+    template<typename Op>
+    concept UnaryArrayMap = requires(const data_t* src, data_t* dst, index_t n) { Op::map(src, dst, n); };
+    template<typename Op>
+    concept FloatingMap = requires { requires Op::floating; };
+    template<typename Op>
+    concept MaskMap = requires { requires Op::mask; };
+
+    inline DType result_type(DType dtype, bool floating) {
+        return floating && !is_floating(dtype) ? DType::Float64 : dtype;
+    }
+
     template<typename SubType>
     class Exp {
     public:
@@ -18,10 +53,29 @@ namespace st {
         std::shared_ptr<SubType> impl_ptr;
     };
 
+    // a number used as an operand, it takes the type of the other operand
+    // instead of taking part in the promotion
+    class Scalar {
+    public:
+        explicit Scalar(data_t value) : value(value) {}
+        [[nodiscard]] data_t eval(const IndexArray&) const { return value; }
+        [[nodiscard]] Shape size() const { return Shape({1}); }
+        [[nodiscard]] index_t size(index_t) const { return 1; }
+        [[nodiscard]] index_t n_dim() const { return 1; }
+        [[nodiscard]] bool overlaps(const TensorImpl&, bool = true) const { return false; }
+        [[nodiscard]] bool is_flat(const Shape&) const { return true; }
+        [[nodiscard]] const data_t* eval_block(index_t, index_t n, data_t* buf) const {
+            std::fill_n(buf, n, value);
+            return buf;
+        }
+    private:
+        data_t value;
+    };
+
     template<typename Op, typename LhsType, typename RhsType>
     class BinaryExp { // Binary Expression
     public:
-        [[nodiscard]] inline data_t eval(IndexArray idx) const {
+        [[nodiscard]] inline data_t eval(const IndexArray& idx) const {
             return Op::eval(idx, lhs_ptr, rhs_ptr);
         }
         BinaryExp(const std::shared_ptr<LhsType>& _lhs, const std::shared_ptr<RhsType> _rhs)
@@ -30,27 +84,101 @@ namespace st {
             return Op::size(lhs_ptr, rhs_ptr);
         }
         [[nodiscard]] index_t size(index_t idx) const {
-            if (idx >= lhs_ptr->n_dim()) return rhs_ptr->size(idx);
-            if (idx >= rhs_ptr->n_dim()) return lhs_ptr->size(idx);
-            return std::max(lhs_ptr->size(idx), rhs_ptr->size(idx));
+            return size()[idx];
         }
         [[nodiscard]] index_t n_dim() const {
             return std::max(lhs_ptr->n_dim(), rhs_ptr->n_dim());
         }
+        [[nodiscard]] DType dtype() const {
+            // a scalar only makes an integer result floating
+            if constexpr (MaskMap<Op>)
+                return DType::UInt8;
+            else if constexpr (std::is_same_v<LhsType, Scalar>)
+                return result_type(rhs_ptr->dtype(), true);
+            else if constexpr (std::is_same_v<RhsType, Scalar>)
+                return result_type(lhs_ptr->dtype(), true);
+            else
+                return result_type(promote_types(lhs_ptr->dtype(), rhs_ptr->dtype()), FloatingMap<Op>);
+        }
+        [[nodiscard]] bool overlaps(const TensorImpl& dst, bool elementwise = true) const {
+            return lhs_ptr->overlaps(dst, elementwise && BinaryMap<Op>)
+                || rhs_ptr->overlaps(dst, elementwise && BinaryMap<Op>);
+        }
+        [[nodiscard]] bool is_flat(const Shape& shape) const {
+            if constexpr (BinaryMap<Op>)
+                return lhs_ptr->is_flat(shape) && rhs_ptr->is_flat(shape);
+            else
+                return false;
+        }
+        [[nodiscard]] const data_t* eval_block(index_t start, index_t n, data_t* buf) const {
+            if constexpr (BinaryMap<Op>) {
+                data_t lhs_buf[BLOCK_SIZE], rhs_buf[BLOCK_SIZE];
+                const data_t* lhs = lhs_ptr->eval_block(start, n, lhs_buf);
+                const data_t* rhs = rhs_ptr->eval_block(start, n, rhs_buf);
+                for (index_t i = 0; i < n; ++i)
+                    buf[i] = Op::apply(lhs[i], rhs[i]);
+            }
+            return buf;
+        }
         ~BinaryExp() = default;
     private:
         std::shared_ptr<LhsType> lhs_ptr;
         std::shared_ptr<RhsType> rhs_ptr;
     };
 
+    // an elementwise select: Op::apply(cond, lhs, rhs) for each element, with
+    // all three operands broadcast against each other
+    template<typename Op, typename CondType, typename LhsType, typename RhsType>
+    class TernaryExp { // Ternary Expression
+    public:
+        [[nodiscard]] inline data_t eval(const IndexArray& idx) const {
+            return Op::eval(idx, cond_ptr, lhs_ptr, rhs_ptr);
+        }
+        TernaryExp(const std::shared_ptr<CondType>& _cond, const std::shared_ptr<LhsType>& _lhs,
+                   const std::shared_ptr<RhsType>& _rhs)
+            : cond_ptr(_cond), lhs_ptr(_lhs), rhs_ptr(_rhs) {}
+        [[nodiscard]] Shape size() const {
+            return Op::size(cond_ptr, lhs_ptr, rhs_ptr);
+        }
+        [[nodiscard]] index_t size(index_t idx) const {
+            return size()[idx];
+        }
+        [[nodiscard]] index_t n_dim() const {
+            return std::max({cond_ptr->n_dim(), lhs_ptr->n_dim(), rhs_ptr->n_dim()});
+        }
+        [[nodiscard]] DType dtype() const {
+            // the condition does not take part, a scalar takes the other type
+            if constexpr (std::is_same_v<LhsType, Scalar>)
+                return rhs_ptr->dtype();
+            else if constexpr (std::is_same_v<RhsType, Scalar>)
+                return lhs_ptr->dtype();
+            else
+                return promote_types(lhs_ptr->dtype(), rhs_ptr->dtype());
+        }
+        [[nodiscard]] bool overlaps(const TensorImpl& dst, bool elementwise = true) const {
+            return cond_ptr->overlaps(dst, elementwise) || lhs_ptr->overlaps(dst, elementwise)
+                || rhs_ptr->overlaps(dst, elementwise);
+        }
+        [[nodiscard]] bool is_flat(const Shape& shape) const {
+            return cond_ptr->is_flat(shape) && lhs_ptr->is_flat(shape) && rhs_ptr->is_flat(shape);
+        }
+        [[nodiscard]] const data_t* eval_block(index_t start, index_t n, data_t* buf) const {
+            return Op::eval_block(start, n, buf, *cond_ptr, *lhs_ptr, *rhs_ptr);
+        }
+    private:
+        std::shared_ptr<CondType> cond_ptr;
+        std::shared_ptr<LhsType> lhs_ptr;
+        std::shared_ptr<RhsType> rhs_ptr;
+    };
+
     template<typename Op, typename LhsType>
     class UnaryExp { // Unary Expression
     public:
-        [[nodiscard]] inline data_t eval(IndexArray idx) const {
+        [[nodiscard]] inline data_t eval(const IndexArray& idx) const {
             return Op::eval(idx, lhs_ptr);
         }
-        UnaryExp(const std::shared_ptr<LhsType>&& ptr): lhs_ptr(ptr) {}
-        [[nodiscard]] Shape& size() const {
+        UnaryExp(const std::shared_ptr<LhsType>& ptr): lhs_ptr(ptr) {}
+        [[nodiscard]] Shape size() const {
             return lhs_ptr->size();
         }
         [[nodiscard]] index_t size(index_t idx) const {
@@ -59,9 +187,28 @@ namespace st {
         [[nodiscard]] index_t n_dim() const {
             return lhs_ptr->n_dim();
         }
+        [[nodiscard]] DType dtype() const {
+            return result_type(lhs_ptr->dtype(), FloatingMap<Op>);
+        }
+        [[nodiscard]] bool overlaps(const TensorImpl& dst, bool elementwise = true) const {
+            return lhs_ptr->overlaps(dst, elementwise);
+        }
+        [[nodiscard]] bool is_flat(const Shape& shape) const {
+            return lhs_ptr->is_flat(shape);
+        }
+        [[nodiscard]] const data_t* eval_block(index_t start, index_t n, data_t* buf) const {
+            const data_t* lhs = lhs_ptr->eval_block(start, n, buf);
+            if constexpr (UnaryArrayMap<Op>) {
+                Op::map(lhs, buf, n);
+            } else {
+                for (index_t i = 0; i < n; ++i)
+                    buf[i] = Op::apply(lhs[i]);
+            }
+            return buf;
+        }
     private:
         std::shared_ptr<LhsType> lhs_ptr;
     };
 }// st
 
-#endif //TENSOR_EXP_H
\ No newline at end of file
+#endif //TENSOR_EXP_H
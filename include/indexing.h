@@ -0,0 +1,27 @@
+#ifndef TENSOR_INDEXING_H
+#define TENSOR_INDEXING_H
+
+// picking and placing elements by integer index tensors (Int8 to Int64)
+
+#include "tensor.h"
+
+namespace st {
+    // the entries of input at positions indices (1D) along dim
+    Tensor index_select(const Tensor& input, index_t dim, const Tensor& indices);
+
+    // res[i][j][k] = input[i][index[i][j][k]][k] for dim 1, and likewise for
+    // the other dims; res has the shape of index
+    Tensor gather(const Tensor& input, index_t dim, const Tensor& index);
+
+    // self[i][index[i][j][k]][k] = src[i][j][k] for dim 1, writing into self.
+    // A position indexed twice keeps the value that comes last in index order.
+    Tensor& scatter(Tensor& self, index_t dim, const Tensor& index, const Tensor& src);
+
+    // as scatter, but adding to self. With deterministic set, every position
+    // receives its additions in index order, so results reproduce bit for bit;
+    // otherwise a 1D scatter_add may run atomic adds from several threads.
+    Tensor& scatter_add(Tensor& self, index_t dim, const Tensor& index, const Tensor& src,
+                        bool deterministic = true);
+} // st
+
+#endif //TENSOR_INDEXING_H
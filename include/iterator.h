@@ -0,0 +1,110 @@
+#ifndef TENSOR_ITERATOR_H
+#define TENSOR_ITERATOR_H
+
+// walking the elements of a strided layout in row-major order
+
+#include "shape.h"
+
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+namespace st {
+    // An element's row-major position pos and its index from the storage
+    // offset. A step along the last dimension only adds that stride; the
+    // index is worked out from pos again when a step carries into an outer
+    // dimension or the cursor jumps. shape and stride belong to the tensor,
+    // which has to outlive the cursor.
+    class StridedCursor {
+    public:
+        StridedCursor() = default;
+        StridedCursor(const Shape* shape, const IndexArray* stride, index_t pos)
+            : _shape(shape), _stride(stride), _last(shape->n_dim()-1),
+              _last_size((*shape)[_last]), _last_stride((*stride)[_last]), _pos(pos) { seek(); }
+
+        [[nodiscard]] index_t pos() const { return _pos; }
+        [[nodiscard]] index_t offset() const { return _offset; }
+
+        void next() {
+            ++_pos;
+            if (++_col < _last_size) _offset += _last_stride;
+            else seek();
+        }
+        void prev() {
+            --_pos;
+            if (_col-- > 0) _offset -= _last_stride;
+            else seek();
+        }
+        void advance(std::ptrdiff_t n) {
+            _pos += n;
+            seek();
+        }
+
+    private:
+        void seek() {
+            index_t rest = _pos;
+            _offset = 0;
+            for (index_t d = _last; d > 0; --d) {
+                index_t size = (*_shape)[d];
+                index_t i = size ? rest % size : 0;
+                if (d == _last) _col = i;
+                _offset += i * (*_stride)[d];
+                rest = size ? rest / size : 0;
+            }
+            if (_last == 0) _col = rest;
+            _offset += rest * (*_stride)[0];
+        }
+
+        const Shape* _shape = nullptr;
+        const IndexArray* _stride = nullptr;
+        index_t _last = 0, _last_size = 0, _last_stride = 0;
+        index_t _pos = 0, _offset = 0, _col = 0; // _col: the index into the last dimension
+    };
+
+    // random access iterator over the T elements of a strided view
+    template<typename T>
+    class StridedIterator {
+    public:
+        using iterator_concept = std::random_access_iterator_tag;
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::remove_cv_t<T>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T*;
+        using reference = T&;
+
+        StridedIterator() = default;
+        StridedIterator(T* data, const Shape* shape, const IndexArray* stride, index_t pos)
+            : _data(data), _cursor(shape, stride, pos) {}
+
+        T& operator*() const { return _data[static_cast<stride_t>(_cursor.offset())]; }
+        T* operator->() const { return &**this; }
+        T& operator[](difference_type n) const { return *(*this + n); }
+
+        StridedIterator& operator++() { _cursor.next(); return *this; }
+        StridedIterator operator++(int) { StridedIterator tmp = *this; _cursor.next(); return tmp; }
+        StridedIterator& operator--() { _cursor.prev(); return *this; }
+        StridedIterator operator--(int) { StridedIterator tmp = *this; _cursor.prev(); return tmp; }
+        StridedIterator& operator+=(difference_type n) { _cursor.advance(n); return *this; }
+        StridedIterator& operator-=(difference_type n) { _cursor.advance(-n); return *this; }
+        friend StridedIterator operator+(StridedIterator it, difference_type n) { return it += n; }
+        friend StridedIterator operator+(difference_type n, StridedIterator it) { return it += n; }
+        friend StridedIterator operator-(StridedIterator it, difference_type n) { return it -= n; }
+        friend difference_type operator-(const StridedIterator& lhs, const StridedIterator& rhs) {
+            return static_cast<difference_type>(lhs._cursor.pos() - rhs._cursor.pos());
+        }
+
+        friend bool operator==(const StridedIterator& lhs, const StridedIterator& rhs) {
+            return lhs._cursor.pos() == rhs._cursor.pos();
+        }
+        friend std::strong_ordering operator<=>(const StridedIterator& lhs, const StridedIterator& rhs) {
+            return lhs._cursor.pos() <=> rhs._cursor.pos();
+        }
+
+    private:
+        T* _data = nullptr;
+        StridedCursor _cursor;
+    };
+} // st
+
+#endif //TENSOR_ITERATOR_H
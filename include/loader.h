@@ -0,0 +1,62 @@
+#ifndef TENSOR_LOADER_H
+#define TENSOR_LOADER_H
+
+// streams a CSV or fixed-width binary file as batch_size x n_fields tensors.
+// A background thread parses ahead into a queue of at most prefetch batches,
+// so memory use does not depend on the file size.
+
+#include "tensor.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace st {
+    struct CsvFormat {
+        char delimiter = ',';
+        index_t skip_rows = 0; // e.g. 1 for a header line
+        DType dtype = DType::Float64;
+    };
+
+    struct BinaryFormat {
+        index_t n_fields; // values per record
+        DType dtype = DType::Float32; // element type in the file and of the batches
+    };
+
+    class BatchLoader {
+    public:
+        BatchLoader(const std::string& path, const CsvFormat& format, index_t batch_size, index_t prefetch = 4);
+        BatchLoader(const std::string& path, const BinaryFormat& format, index_t batch_size, index_t prefetch = 4);
+        BatchLoader(const BatchLoader& other) = delete;
+        BatchLoader& operator=(const BatchLoader& other) = delete;
+        ~BatchLoader();
+
+        [[nodiscard]] index_t n_fields() const { return _n_fields; }
+        // the next batch, contiguous; the last one may hold fewer rows. Empty
+        // once the file is exhausted. A parse error is rethrown here.
+        [[nodiscard]] std::optional<Tensor> next();
+
+    private:
+        // fill writes up to batch_size rows into a batch and returns how many it wrote
+        void start(std::function<index_t(Tensor&)> fill, DType dtype);
+
+        index_t _n_fields;
+        index_t _batch_size;
+        index_t _prefetch;
+        std::deque<Tensor> _queue;
+        bool _done = false;
+        bool _stop = false;
+        std::exception_ptr _error;
+        std::mutex _mutex;
+        std::condition_variable _not_empty;
+        std::condition_variable _not_full;
+        std::thread _worker;
+    };
+} // st
+
+#endif //TENSOR_LOADER_H
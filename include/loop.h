@@ -0,0 +1,108 @@
+#ifndef TENSOR_LOOP_H
+#define TENSOR_LOOP_H
+
+// loop nests over strided layouts, shared by the kernels that walk tensors
+// without caring about the order they see the elements in
+
+#include "shape.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace st {
+    // the dimensions of shape from the outermost loop to the innermost one,
+    // ordered by decreasing |stride| and otherwise kept in logical order
+    inline std::vector<index_t> stride_order(const Shape& shape, const IndexArray& stride) {
+        std::vector<index_t> order(shape.n_dim());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](index_t a, index_t b) {
+            return std::abs((stride_t)stride[a]) > std::abs((stride_t)stride[b]);
+        });
+        return order;
+    }
+
+    // A loop over every element of a shape for N operands with strides of
+    // their own. Dimensions of size 1 are dropped, the rest ordered by the
+    // first operand's strides, and neighbours merged whenever every operand
+    // steps through them as through one dimension; a contiguous tensor of
+    // any rank becomes one row. The elements are visited in a different
+    // order than the logical one.
+    template<index_t N>
+    struct LoopNest {
+        std::vector<index_t> shape;                 // outermost first
+        std::array<std::vector<index_t>, N> stride; // per operand
+
+        [[nodiscard]] index_t n_dim() const { return shape.size(); }
+        // length of the innermost loop, and the number of such rows
+        [[nodiscard]] index_t cols() const { return shape.back(); }
+        [[nodiscard]] index_t rows() const {
+            index_t res = 1;
+            for (index_t d = 0; d+1 < n_dim(); ++d) res *= shape[d];
+            return res;
+        }
+    };
+
+    // reorder = false keeps the logical order of the dimensions and only merges them
+    template<index_t N>
+    LoopNest<N> make_loop(const Shape& shape, const std::array<const IndexArray*, N>& stride, bool reorder = true) {
+        std::vector<index_t> order(shape.n_dim());
+        if (reorder) order = stride_order(shape, *stride[0]);
+        else std::iota(order.begin(), order.end(), 0);
+
+        LoopNest<N> loop;
+        for (index_t d : order) {
+            if (shape[d] == 1) continue;
+            bool merge = !loop.shape.empty();
+            for (index_t k = 0; k < N && merge; ++k)
+                merge = loop.stride[k].back() == (*stride[k])[d] * shape[d];
+            if (merge) {
+                loop.shape.back() *= shape[d];
+                for (index_t k = 0; k < N; ++k) loop.stride[k].back() = (*stride[k])[d];
+            } else {
+                loop.shape.push_back(shape[d]);
+                for (index_t k = 0; k < N; ++k) loop.stride[k].push_back((*stride[k])[d]);
+            }
+        }
+        if (loop.shape.empty()) {
+            loop.shape.push_back(1);
+            for (index_t k = 0; k < N; ++k) loop.stride[k].push_back(0);
+        }
+        return loop;
+    }
+
+    // calls f(offset) for rows [begin, end) of loop, offset[k] being the index
+    // of the row's first element in operand k; row elements follow at
+    // loop.stride[k].back()
+    template<index_t N, typename F>
+    void for_each_row(const LoopNest<N>& loop, index_t begin, index_t end, F&& f) {
+        if (loop.cols() == 0) return;
+        index_t n = loop.n_dim()-1;
+        std::vector<index_t> cnt(n);
+        std::array<index_t, N> offset{};
+        for (index_t d = n, rest = begin; d-- > 0; rest /= loop.shape[d]) {
+            cnt[d] = rest % loop.shape[d];
+            for (index_t k = 0; k < N; ++k) offset[k] += cnt[d] * loop.stride[k][d];
+        }
+        for (index_t r = begin; r < end; ++r) {
+            f(std::as_const(offset));
+            for (index_t d = n; d-- > 0;) {
+                if (++cnt[d] < loop.shape[d]) {
+                    for (index_t k = 0; k < N; ++k) offset[k] += loop.stride[k][d];
+                    break;
+                }
+                for (index_t k = 0; k < N; ++k) offset[k] -= (cnt[d]-1) * loop.stride[k][d];
+                cnt[d] = 0;
+            }
+        }
+    }
+    template<index_t N, typename F>
+    void for_each_row(const LoopNest<N>& loop, F&& f) {
+        for_each_row(loop, 0, loop.rows(), f);
+    }
+} // st
+
+#endif //TENSOR_LOOP_H
@@ -0,0 +1,22 @@
+#ifndef TENSOR_NPY_H
+#define TENSOR_NPY_H
+
+// NumPy .npy files and uncompressed .npz archives. Loading maps the payload,
+// so a C or Fortran ordered array becomes a tensor over the file with the
+// matching strides. Only little endian data is supported; bfloat16 has no
+// NumPy equivalent.
+
+#include "tensor.h"
+
+#include <map>
+#include <string>
+
+namespace st {
+    [[nodiscard]] Tensor load_npy(const std::string& path, MapMode mode = MapMode::ReadOnly);
+    void save_npy(const std::string& path, const Tensor& tensor);
+    // keys are the archive member names without the .npy suffix, as np.savez writes them
+    [[nodiscard]] std::map<std::string, Tensor> load_npz(const std::string& path, MapMode mode = MapMode::ReadOnly);
+    void save_npz(const std::string& path, const std::map<std::string, Tensor>& tensors);
+} // st
+
+#endif //TENSOR_NPY_H
@@ -5,21 +5,37 @@
 #include "exp.h"
 #include "storage.h"
 #include "exception.h"
+#include "vmath.h"
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
 #include <assert.h>
 
 namespace st {
     namespace op {
+        // shape of two operands broadcast against each other from the last dimension
+        inline Shape broadcast_size(const Shape& lhs, const Shape& rhs) {
+            Shape res(std::max(lhs.n_dim(), rhs.n_dim()));
+            int n = res.n_dim(), nl = lhs.n_dim(), nr = rhs.n_dim();
+            for (int i = 0; i < n; ++i) {
+                index_t l = i >= n-nl ? lhs[i-(n-nl)] : 1;
+                index_t r = i >= n-nr ? rhs[i-(n-nr)] : 1;
+                res[i] = l == 1 ? r : l;
+            }
+            return res;
+        }
+
         struct Add {
+            static data_t apply(data_t lhs, data_t rhs) { return lhs+rhs; }
             template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
                 CHECK_EXP_BROADCAST(lhs, rhs);
-                return lhs->eval(idx)+rhs->eval(idx);
+                return apply(lhs->eval(idx), rhs->eval(idx));
             }
             template<typename LhsType, typename RhsType>
             static Shape size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+                return broadcast_size(lhs->size(), rhs->size());
             }
             template<typename LhsType, typename RhsType>
             static index_t size(index_t idx, const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
@@ -33,50 +49,111 @@ namespace st {
             }
         };
         struct Sub {
+            static data_t apply(data_t lhs, data_t rhs) { return lhs-rhs; }
             template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
                 CHECK_EXP_BROADCAST(lhs, rhs);
-                return lhs->eval(idx)-rhs->eval(idx);
+                return apply(lhs->eval(idx), rhs->eval(idx));
             }
             template<typename LhsType, typename RhsType>
             static Shape size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+                return broadcast_size(lhs->size(), rhs->size());
             }
         };
         struct Mul {
+            static data_t apply(data_t lhs, data_t rhs) { return lhs*rhs; }
             template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
                 CHECK_EXP_BROADCAST(lhs, rhs);
-                return lhs->eval(idx)*rhs->eval(idx);
+                return apply(lhs->eval(idx), rhs->eval(idx));
             }
             template<typename LhsType, typename RhsType>
             static Shape size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+                return broadcast_size(lhs->size(), rhs->size());
             }
         };
         struct Div {
+            static constexpr bool floating = true;
+            static data_t apply(data_t lhs, data_t rhs) {
+                CHECK_FLOAT_EQUAL(rhs, 0, "divisor cannot be zero");
+                return lhs/rhs;
+            }
+            template<typename LhsType, typename RhsType>
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs->eval(idx), rhs->eval(idx));
+            }
+            template<typename LhsType, typename RhsType>
+            static Shape size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
+                return broadcast_size(lhs->size(), rhs->size());
+            }
+        };
+        // comparisons give 1 where Cmp holds and 0 elsewhere, stored as UInt8
+        template<typename Cmp>
+        struct Compare {
+            static constexpr bool mask = true;
+            static data_t apply(data_t lhs, data_t rhs) { return Cmp()(lhs, rhs) ? 1 : 0; }
             template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
                 CHECK_EXP_BROADCAST(lhs, rhs);
-                data_t r = rhs->eval(idx);
-                CHECK_FLOAT_EQUAL(r, 0, "divisor cannot be zero");
-                return lhs->eval(idx)/rhs->eval(idx);
+                return apply(lhs->eval(idx), rhs->eval(idx));
             }
             template<typename LhsType, typename RhsType>
-            static const Shape& size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            static Shape size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
+                return broadcast_size(lhs->size(), rhs->size());
             }
         };
+        using Less = Compare<std::less<data_t>>;
+        using LessEqual = Compare<std::less_equal<data_t>>;
+        using Greater = Compare<std::greater<data_t>>;
+        using GreaterEqual = Compare<std::greater_equal<data_t>>;
+        using Equal = Compare<std::equal_to<data_t>>;
+        using NotEqual = Compare<std::not_equal_to<data_t>>;
+
+        struct Where {
+            static data_t apply(data_t cond, data_t lhs, data_t rhs) { return cond != 0 ? lhs : rhs; }
+            template<typename CondType, typename LhsType, typename RhsType>
+            static data_t eval(const IndexArray& idx, std::shared_ptr<CondType> cond,
+                               std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
+                CHECK_EXP_BROADCAST(cond, lhs);
+                CHECK_EXP_BROADCAST(cond, rhs);
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                // only the selected side is evaluated
+                return cond->eval(idx) != 0 ? lhs->eval(idx) : rhs->eval(idx);
+            }
+            template<typename CondType, typename LhsType, typename RhsType>
+            static Shape size(const std::shared_ptr<CondType>& cond, const std::shared_ptr<LhsType>& lhs,
+                              const std::shared_ptr<RhsType>& rhs) {
+                return broadcast_size(cond->size(), broadcast_size(lhs->size(), rhs->size()));
+            }
+            // a block whose mask is all nonzero or all zero evaluates only that
+            // side; a mixed block evaluates both and selects per element
+            template<typename CondType, typename LhsType, typename RhsType>
+            static const data_t* eval_block(index_t start, index_t n, data_t* buf, const CondType& cond,
+                                            const LhsType& lhs, const RhsType& rhs) {
+                data_t cond_buf[BLOCK_SIZE], lhs_buf[BLOCK_SIZE], rhs_buf[BLOCK_SIZE];
+                const data_t* c = cond.eval_block(start, n, cond_buf);
+                index_t selected = std::count_if(c, c+n, [](data_t v) { return v != 0; });
+                if (selected == n) return lhs.eval_block(start, n, buf);
+                if (selected == 0) return rhs.eval_block(start, n, buf);
+                const data_t* l = lhs.eval_block(start, n, lhs_buf);
+                const data_t* r = rhs.eval_block(start, n, rhs_buf);
+                for (index_t i = 0; i < n; ++i)
+                    buf[i] = apply(c[i], l[i], r[i]);
+                return buf;
+            }
+        };
+
         struct MatrixMul_2dim {
             template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
                 const Shape& ls = lhs->size();
                 const Shape& rs = rhs->size();
                 index_t l0 = ls[0], l1 = ls[1], r0 = rs[0], r1 = rs[1];
                 // default l1 == r0
                 // default lhs and rhs is 2-dimensional
                 CHECK_EQUAL(l1, r0,
-                            "mat1 and mat2 shapes cannot be multiplied (%dx%d and %dx%d)", l0, l1, r0, r1);
+                            "mat1 and mat2 shapes cannot be multiplied (%zux%zu and %zux%zu)", l0, l1, r0, r1);
                 data_t res = 0;
                 for (index_t i = 0; i < l1; ++i) {
                     res += lhs->eval({idx[0], i})*rhs->eval({i, idx[1]});
@@ -90,14 +167,14 @@ namespace st {
         };
         struct MatrixMul_3dim {
             template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
                 const Shape& ls = lhs->size();
                 const Shape& rs = rhs->size();
                 index_t l0 = ls[0], l1 = ls[1], l2 = ls[2], r0 = rs[0], r1 = rs[1], r2 = rs[2];
                 // default l2 == r1
                 // default lhs and rhs is 3-dimensional
                 CHECK_EQUAL(l1, r0,
-                            "mat1 and mat2 shapes cannot be multiplied (%dx%d and %dx%d)", l0, l1, r0, r1);
+                            "mat1 and mat2 shapes cannot be multiplied (%zux%zu and %zux%zu)", l0, l1, r0, r1);
                 data_t res = 0;
                 for (index_t i = 0; i < l2; ++i) {
                     res += lhs->eval({idx[0], idx[1], i})*rhs->eval({idx[0], i, idx[2]});
@@ -111,19 +188,19 @@ namespace st {
         };
         struct MatrixMul {
             template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
-                int l0, l1;
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
+                index_t l0, l1;
                 l0 = lhs->size()[lhs->n_dim()-2];
                 l1 = lhs->size()[lhs->n_dim()-1];
-                int r0, r1;
+                index_t r0, r1;
                 r0 = rhs->size()[rhs->n_dim()-2];
                 r1 = rhs->size()[rhs->n_dim()-1];
                 data_t res = 0;
                 CHECK_EQUAL(l1, r0,
-                            "mat1 and mat2 shapes cannot be multiplied (%dx%d and %dx%d)", l0, l1, r0, r1);
-                for (int i = 0; i < l1; ++i) {
-                    IndexArray lidx = idx;
-                    IndexArray ridx = idx;
+                            "mat1 and mat2 shapes cannot be multiplied (%zux%zu and %zux%zu)", l0, l1, r0, r1);
+                IndexArray lidx = idx;
+                IndexArray ridx = idx;
+                for (index_t i = 0; i < l1; ++i) {
                     lidx[idx.size()-1] = i;
                     ridx[idx.size()-2] = i;
                     res += lhs->eval(lidx)*rhs->eval(ridx);
@@ -146,43 +223,73 @@ namespace st {
             }
         };
         struct Neg {
+            static data_t apply(data_t lhs) { return -lhs; }
             template<typename LhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs) {
-                return -lhs->eval(idx);
-            }
-            template<typename LhsType, typename RhsType>
-            static const Shape& size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs) {
+                return apply(lhs->eval(idx));
             }
         };
         struct Sin {
+            static constexpr bool floating = true;
+            static data_t apply(data_t lhs) { return vmath::sin(lhs); }
+            static void map(const data_t* src, data_t* dst, index_t n) { vmath::sin(src, dst, n); }
             template<typename LhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs) {
-                return std::sin(lhs->eval(idx));
-            }
-            template<typename LhsType, typename RhsType>
-            static const Shape& size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs) {
+                return apply(lhs->eval(idx));
             }
         };
         struct Cos {
+            static constexpr bool floating = true;
+            static data_t apply(data_t lhs) { return vmath::cos(lhs); }
+            static void map(const data_t* src, data_t* dst, index_t n) { vmath::cos(src, dst, n); }
             template<typename LhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs) {
-                return std::cos(lhs->eval(idx));
-            }
-            template<typename LhsType, typename RhsType>
-            static const Shape& size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs) {
+                return apply(lhs->eval(idx));
             }
         };
         struct Tan {
+            static constexpr bool floating = true;
+            static data_t apply(data_t lhs) { return vmath::tan(lhs); }
+            static void map(const data_t* src, data_t* dst, index_t n) { vmath::tan(src, dst, n); }
             template<typename LhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs) {
-                return std::tan(lhs->eval(idx));
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs) {
+                return apply(lhs->eval(idx));
             }
-            template<typename LhsType, typename RhsType>
-            static const Shape& size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+        };
+        struct Exponential {
+            static constexpr bool floating = true;
+            static data_t apply(data_t lhs) { return vmath::exp(lhs); }
+            static void map(const data_t* src, data_t* dst, index_t n) { vmath::exp(src, dst, n); }
+            template<typename LhsType>
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs) {
+                return apply(lhs->eval(idx));
+            }
+        };
+        struct Log {
+            static constexpr bool floating = true;
+            static data_t apply(data_t lhs) { return vmath::log(lhs); }
+            static void map(const data_t* src, data_t* dst, index_t n) { vmath::log(src, dst, n); }
+            template<typename LhsType>
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs) {
+                return apply(lhs->eval(idx));
+            }
+        };
+        struct Tanh {
+            static constexpr bool floating = true;
+            static data_t apply(data_t lhs) { return vmath::tanh(lhs); }
+            static void map(const data_t* src, data_t* dst, index_t n) { vmath::tanh(src, dst, n); }
+            template<typename LhsType>
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs) {
+                return apply(lhs->eval(idx));
+            }
+        };
+        struct Sigmoid {
+            static constexpr bool floating = true;
+            static data_t apply(data_t lhs) { return vmath::sigmoid(lhs); }
+            static void map(const data_t* src, data_t* dst, index_t n) { vmath::sigmoid(src, dst, n); }
+            template<typename LhsType>
+            static data_t eval(const IndexArray& idx, std::shared_ptr<LhsType> lhs) {
+                return apply(lhs->eval(idx));
             }
         };
     } // op
@@ -209,10 +316,9 @@ namespace st {
     }
 
     template<typename RhsType>
-    [[nodiscard]] inline Exp<BinaryExp<op::Mul, TensorImpl, RhsType>> operator*(data_t lhs_value, const Exp<RhsType>& rhs) {
-        auto lhs = Exp<TensorImpl>(std::make_shared<TensorImpl>(Storage(1, lhs_value), Shape({1})));
-        return Exp<BinaryExp<op::Mul, TensorImpl, RhsType>>(
-                std::make_shared<BinaryExp<op::Mul, TensorImpl, RhsType>>(lhs.ptr(), rhs.ptr())
+    [[nodiscard]] inline Exp<BinaryExp<op::Mul, Scalar, RhsType>> operator*(data_t lhs_value, const Exp<RhsType>& rhs) {
+        return Exp<BinaryExp<op::Mul, Scalar, RhsType>>(
+                std::make_shared<BinaryExp<op::Mul, Scalar, RhsType>>(std::make_shared<Scalar>(lhs_value), rhs.ptr())
         );
     }
 
@@ -245,23 +351,171 @@ namespace st {
     }
 
     template<typename LhsType>
-    [[nodiscard]] inline UnaryExp<op::Neg, LhsType> operator-(const Exp<LhsType>& lhs) {
-        return UnaryExp<op::Neg, LhsType>(lhs.ptr());
+    [[nodiscard]] inline Exp<UnaryExp<op::Neg, LhsType>> operator-(const Exp<LhsType>& lhs) {
+        return Exp<UnaryExp<op::Neg, LhsType>>(
+                std::make_shared<UnaryExp<op::Neg, LhsType>>(lhs.ptr())
+        );
     }
 
     template<typename LhsType>
-    [[nodiscard]] inline UnaryExp<op::Sin, LhsType> sin(const Exp<LhsType>& lhs) {
-        return UnaryExp<op::Sin, LhsType>(lhs.ptr());
+    [[nodiscard]] inline Exp<UnaryExp<op::Sin, LhsType>> sin(const Exp<LhsType>& lhs) {
+        return Exp<UnaryExp<op::Sin, LhsType>>(
+                std::make_shared<UnaryExp<op::Sin, LhsType>>(lhs.ptr())
+        );
     }
 
     template<typename LhsType>
-    [[nodiscard]] inline UnaryExp<op::Cos, LhsType> cos(const Exp<LhsType>& lhs) {
-        return UnaryExp<op::Cos, LhsType>(lhs.ptr());
+    [[nodiscard]] inline Exp<UnaryExp<op::Cos, LhsType>> cos(const Exp<LhsType>& lhs) {
+        return Exp<UnaryExp<op::Cos, LhsType>>(
+                std::make_shared<UnaryExp<op::Cos, LhsType>>(lhs.ptr())
+        );
     }
 
     template<typename LhsType>
-    [[nodiscard]] inline UnaryExp<op::Tan, LhsType> tan(const Exp<LhsType>& lhs) {
-        return UnaryExp<op::Tan, LhsType>(lhs.ptr());
+    [[nodiscard]] inline Exp<UnaryExp<op::Tan, LhsType>> tan(const Exp<LhsType>& lhs) {
+        return Exp<UnaryExp<op::Tan, LhsType>>(
+                std::make_shared<UnaryExp<op::Tan, LhsType>>(lhs.ptr())
+        );
+    }
+
+    template<typename LhsType>
+    [[nodiscard]] inline Exp<UnaryExp<op::Exponential, LhsType>> exp(const Exp<LhsType>& lhs) {
+        return Exp<UnaryExp<op::Exponential, LhsType>>(
+                std::make_shared<UnaryExp<op::Exponential, LhsType>>(lhs.ptr())
+        );
+    }
+
+    template<typename LhsType>
+    [[nodiscard]] inline Exp<UnaryExp<op::Log, LhsType>> log(const Exp<LhsType>& lhs) {
+        return Exp<UnaryExp<op::Log, LhsType>>(
+                std::make_shared<UnaryExp<op::Log, LhsType>>(lhs.ptr())
+        );
+    }
+
+    template<typename LhsType>
+    [[nodiscard]] inline Exp<UnaryExp<op::Tanh, LhsType>> tanh(const Exp<LhsType>& lhs) {
+        return Exp<UnaryExp<op::Tanh, LhsType>>(
+                std::make_shared<UnaryExp<op::Tanh, LhsType>>(lhs.ptr())
+        );
+    }
+
+    template<typename LhsType>
+    [[nodiscard]] inline Exp<UnaryExp<op::Sigmoid, LhsType>> sigmoid(const Exp<LhsType>& lhs) {
+        return Exp<UnaryExp<op::Sigmoid, LhsType>>(
+                std::make_shared<UnaryExp<op::Sigmoid, LhsType>>(lhs.ptr())
+        );
+    }
+    // Comparisons make masks: lazy, and UInt8 when materialized. eq and ne are
+    // functions rather than operators so that == keeps comparing objects.
+    template<typename LhsType, typename RhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::Less, LhsType, RhsType>> operator<(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
+        return Exp<BinaryExp<op::Less, LhsType, RhsType>>(
+                std::make_shared<BinaryExp<op::Less, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
+        );
+    }
+    template<typename LhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::Less, LhsType, Scalar>> operator<(const Exp<LhsType>& lhs, data_t rhs_value) {
+        return Exp<BinaryExp<op::Less, LhsType, Scalar>>(
+                std::make_shared<BinaryExp<op::Less, LhsType, Scalar>>(lhs.ptr(), std::make_shared<Scalar>(rhs_value))
+        );
+    }
+
+    template<typename LhsType, typename RhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::LessEqual, LhsType, RhsType>> operator<=(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
+        return Exp<BinaryExp<op::LessEqual, LhsType, RhsType>>(
+                std::make_shared<BinaryExp<op::LessEqual, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
+        );
+    }
+    template<typename LhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::LessEqual, LhsType, Scalar>> operator<=(const Exp<LhsType>& lhs, data_t rhs_value) {
+        return Exp<BinaryExp<op::LessEqual, LhsType, Scalar>>(
+                std::make_shared<BinaryExp<op::LessEqual, LhsType, Scalar>>(lhs.ptr(), std::make_shared<Scalar>(rhs_value))
+        );
+    }
+
+    template<typename LhsType, typename RhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::Greater, LhsType, RhsType>> operator>(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
+        return Exp<BinaryExp<op::Greater, LhsType, RhsType>>(
+                std::make_shared<BinaryExp<op::Greater, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
+        );
+    }
+    template<typename LhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::Greater, LhsType, Scalar>> operator>(const Exp<LhsType>& lhs, data_t rhs_value) {
+        return Exp<BinaryExp<op::Greater, LhsType, Scalar>>(
+                std::make_shared<BinaryExp<op::Greater, LhsType, Scalar>>(lhs.ptr(), std::make_shared<Scalar>(rhs_value))
+        );
+    }
+
+    template<typename LhsType, typename RhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::GreaterEqual, LhsType, RhsType>> operator>=(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
+        return Exp<BinaryExp<op::GreaterEqual, LhsType, RhsType>>(
+                std::make_shared<BinaryExp<op::GreaterEqual, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
+        );
+    }
+    template<typename LhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::GreaterEqual, LhsType, Scalar>> operator>=(const Exp<LhsType>& lhs, data_t rhs_value) {
+        return Exp<BinaryExp<op::GreaterEqual, LhsType, Scalar>>(
+                std::make_shared<BinaryExp<op::GreaterEqual, LhsType, Scalar>>(lhs.ptr(), std::make_shared<Scalar>(rhs_value))
+        );
+    }
+
+    template<typename LhsType, typename RhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::Equal, LhsType, RhsType>> eq(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
+        return Exp<BinaryExp<op::Equal, LhsType, RhsType>>(
+                std::make_shared<BinaryExp<op::Equal, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
+        );
+    }
+    template<typename LhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::Equal, LhsType, Scalar>> eq(const Exp<LhsType>& lhs, data_t rhs_value) {
+        return Exp<BinaryExp<op::Equal, LhsType, Scalar>>(
+                std::make_shared<BinaryExp<op::Equal, LhsType, Scalar>>(lhs.ptr(), std::make_shared<Scalar>(rhs_value))
+        );
+    }
+
+    template<typename LhsType, typename RhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::NotEqual, LhsType, RhsType>> ne(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
+        return Exp<BinaryExp<op::NotEqual, LhsType, RhsType>>(
+                std::make_shared<BinaryExp<op::NotEqual, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
+        );
+    }
+    template<typename LhsType>
+    [[nodiscard]] inline Exp<BinaryExp<op::NotEqual, LhsType, Scalar>> ne(const Exp<LhsType>& lhs, data_t rhs_value) {
+        return Exp<BinaryExp<op::NotEqual, LhsType, Scalar>>(
+                std::make_shared<BinaryExp<op::NotEqual, LhsType, Scalar>>(lhs.ptr(), std::make_shared<Scalar>(rhs_value))
+        );
+    }
+
+    // lhs where cond is nonzero and rhs elsewhere, evaluated in the same pass
+    // as the rest of the expression
+    template<typename CondType, typename LhsType, typename RhsType>
+    [[nodiscard]] inline Exp<TernaryExp<op::Where, CondType, LhsType, RhsType>>
+    where(const Exp<CondType>& cond, const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
+        return Exp<TernaryExp<op::Where, CondType, LhsType, RhsType>>(
+                std::make_shared<TernaryExp<op::Where, CondType, LhsType, RhsType>>(cond.ptr(), lhs.ptr(), rhs.ptr())
+        );
+    }
+    template<typename CondType, typename LhsType>
+    [[nodiscard]] inline Exp<TernaryExp<op::Where, CondType, LhsType, Scalar>>
+    where(const Exp<CondType>& cond, const Exp<LhsType>& lhs, data_t rhs_value) {
+        return Exp<TernaryExp<op::Where, CondType, LhsType, Scalar>>(
+                std::make_shared<TernaryExp<op::Where, CondType, LhsType, Scalar>>(
+                    cond.ptr(), lhs.ptr(), std::make_shared<Scalar>(rhs_value))
+        );
+    }
+    template<typename CondType, typename RhsType>
+    [[nodiscard]] inline Exp<TernaryExp<op::Where, CondType, Scalar, RhsType>>
+    where(const Exp<CondType>& cond, data_t lhs_value, const Exp<RhsType>& rhs) {
+        return Exp<TernaryExp<op::Where, CondType, Scalar, RhsType>>(
+                std::make_shared<TernaryExp<op::Where, CondType, Scalar, RhsType>>(
+                    cond.ptr(), std::make_shared<Scalar>(lhs_value), rhs.ptr())
+        );
+    }
+
+    // input with value wherever mask is nonzero
+    template<typename LhsType, typename MaskType>
+    [[nodiscard]] inline Exp<TernaryExp<op::Where, MaskType, Scalar, LhsType>>
+    masked_fill(const Exp<LhsType>& input, const Exp<MaskType>& mask, data_t value) {
+        return where(mask, value, input);
     }
 } // st
 
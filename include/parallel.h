@@ -0,0 +1,48 @@
+#ifndef TENSOR_PARALLEL_H
+#define TENSOR_PARALLEL_H
+
+// splitting a kernel's work items between threads
+
+#include "allocator.h"
+
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace st {
+    // below this many elements moved a kernel is not worth the thread start-up
+    constexpr index_t PARALLEL_WORK = 1 << 18;
+
+    // calls f(begin, end) on consecutive ranges covering [0, n). The ranges
+    // go to up to hardware_concurrency() threads when work, the number of
+    // elements the whole loop touches, reaches PARALLEL_WORK, and f runs
+    // inline otherwise. The first exception thrown by f is rethrown here.
+    template<typename F>
+    void parallel_for(index_t n, index_t work, F&& f) {
+        index_t n_threads = work < PARALLEL_WORK ? 1
+            : std::min<index_t>(std::max(1u, std::thread::hardware_concurrency()), n);
+        if (n_threads <= 1) {
+            if (n > 0) f(index_t(0), n);
+            return;
+        }
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::vector<std::thread> threads;
+        for (index_t t = 0; t < n_threads; ++t)
+            threads.emplace_back([&, t] {
+                try {
+                    f(n*t/n_threads, n*(t+1)/n_threads);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) error = std::current_exception();
+                }
+            });
+        for (auto& thread : threads)
+            thread.join();
+        if (error) std::rethrow_exception(error);
+    }
+} // st
+
+#endif //TENSOR_PARALLEL_H
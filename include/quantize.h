@@ -0,0 +1,45 @@
+#ifndef TENSOR_QUANTIZE_H
+#define TENSOR_QUANTIZE_H
+
+// 8-bit affine quantization: x = (q - zero_point) * scale
+
+#include "tensor.h"
+
+#include <vector>
+
+namespace st {
+    class QTensor {
+    public:
+        // axis < 0: one scale and zero point for the whole tensor, otherwise
+        // one per index along axis
+        QTensor(const Tensor& data, std::vector<data_t> scale, std::vector<int32_t> zero_point, int axis = -1);
+
+        [[nodiscard]] const Tensor& data() const { return _data; } // Int8 or UInt8
+        [[nodiscard]] DType dtype() const { return _data.dtype(); }
+        [[nodiscard]] index_t n_dim() const { return _data.n_dim(); }
+        [[nodiscard]] index_t size(index_t idx) const { return _data.size(idx); }
+        [[nodiscard]] const Shape& size() const { return _data.size(); }
+        [[nodiscard]] int axis() const { return _axis; }
+        [[nodiscard]] data_t scale(index_t channel = 0) const { return _scale[_axis < 0 ? 0 : channel]; }
+        [[nodiscard]] int32_t zero_point(index_t channel = 0) const { return _zero_point[_axis < 0 ? 0 : channel]; }
+
+    private:
+        Tensor _data;
+        std::vector<data_t> _scale;
+        std::vector<int32_t> _zero_point;
+        int _axis;
+    };
+
+    [[nodiscard]] QTensor quantize(const Tensor& tensor, data_t scale, int32_t zero_point,
+                                   DType dtype = DType::UInt8);
+    [[nodiscard]] QTensor quantize_per_channel(const Tensor& tensor, const std::vector<data_t>& scale,
+                                               const std::vector<int32_t>& zero_point, index_t axis,
+                                               DType dtype = DType::Int8);
+    [[nodiscard]] Tensor dequantize(const QTensor& tensor, DType dtype = DType::Float32);
+
+    // 2D product accumulated exactly in integers and dequantized into dtype. lhs
+    // may be quantized per tensor or per row, rhs per tensor or per column.
+    [[nodiscard]] Tensor matmul(const QTensor& lhs, const QTensor& rhs, DType dtype = DType::Float32);
+} // st
+
+#endif //TENSOR_QUANTIZE_H
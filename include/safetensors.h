@@ -0,0 +1,42 @@
+#ifndef TENSOR_SAFETENSORS_H
+#define TENSOR_SAFETENSORS_H
+
+// reader for the safetensors format: a u64 header length, a JSON header
+// {"name": {"dtype": "F32", "shape": [2, 3], "data_offsets": [begin, end]}, ...}
+// and the raw little endian data. The header is parsed on open; each tensor
+// is mapped on first access, so tensors never asked for are never paged in.
+
+#include "tensor.h"
+
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace st {
+    class SafeTensors {
+    public:
+        explicit SafeTensors(const std::string& path, MapMode mode = MapMode::ReadOnly);
+
+        [[nodiscard]] std::vector<std::string> names() const;
+        [[nodiscard]] bool contains(const std::string& name) const { return _entries.count(name) != 0; }
+        [[nodiscard]] const std::map<std::string, std::string>& metadata() const { return _metadata; }
+        // maps the tensor the first time, later calls return the same tensor
+        [[nodiscard]] Tensor get(const std::string& name);
+
+    private:
+        struct Entry {
+            std::string dtype;
+            std::vector<index_t> shape;
+            index_t begin, end; // byte range relative to the end of the header
+            std::optional<Tensor> tensor;
+        };
+        std::string _path;
+        MapMode _mode;
+        index_t _data_offset;
+        std::map<std::string, Entry> _entries;
+        std::map<std::string, std::string> _metadata;
+    };
+} // st
+
+#endif //TENSOR_SAFETENSORS_H
@@ -0,0 +1,21 @@
+#ifndef TENSOR_SERIALIZE_H
+#define TENSOR_SERIALIZE_H
+
+// native binary container for named tensors. Layout, little endian:
+//   "STTENSOR" | u32 version | u32 count
+//   count x { u32 name length | name | u8 dtype | u8 n_dim | u64 dims[n_dim]
+//             | u64 strides[n_dim] | u64 payload offset | u64 payload bytes }
+//   payloads, each starting on a 64-byte boundary
+// load() maps the payloads instead of reading them.
+
+#include "tensor.h"
+
+#include <map>
+#include <string>
+
+namespace st {
+    void save(const std::string& path, const std::map<std::string, Tensor>& tensors);
+    [[nodiscard]] std::map<std::string, Tensor> load(const std::string& path, MapMode mode = MapMode::ReadOnly);
+} // st
+
+#endif //TENSOR_SERIALIZE_H
@@ -2,16 +2,42 @@
 #define TENSOR_STORAGE_H
 
 #include "allocator.h"
+#include "dtype.h"
+
+#include <functional>
+#include <string>
+#include <utility>
 
 namespace st {
-    typedef double data_t;
+    // Views of a tensor share one Block, so they see each other's writes and
+    // share a version counter. copy() makes a logical copy: a new Block over
+    // the same buffer, which is duplicated only when one side writes to it.
+    // Every write goes through the non-const raw()/data() or an ElementRef;
+    // a pointer taken before a copy was made keeps pointing at the shared buffer.
+    class ElementRef;
+
+    enum class MapMode {
+        ReadOnly,   // shared with the page cache; writes throw, while a clone() copies
+                    // the data out on its first write
+        CopyOnWrite // MAP_PRIVATE; written pages become private to the process
+    };
+
     class Storage {
     public:
-        explicit Storage(index_t size);
+        explicit Storage(index_t size, DType dtype = DType::Float64);
         Storage(const Storage& other, index_t offset);
-        Storage(index_t size, data_t value);
-        Storage(const data_t *data, index_t size);
+        Storage(index_t size, data_t value, DType dtype = DType::Float64);
+        Storage(const data_t *data, index_t size, DType dtype = DType::Float64);
         Storage(const std::initializer_list<data_t>& list);
+        // wraps size elements at data without copying them; release(data) runs
+        // once no Storage refers to the buffer any more. Writes always land in
+        // data: copy() duplicates a blob right away instead of sharing it.
+        static Storage from_blob(void* data, index_t size, DType dtype = DType::Float64,
+                                 std::function<void(void*)> release = {});
+        // maps size elements of a file starting at byte offset; size 0 maps up
+        // to the end of the file. Pages are read in only when touched.
+        static Storage map_file(const std::string& path, DType dtype = DType::Float64,
+                                MapMode mode = MapMode::ReadOnly, index_t offset = 0, index_t size = 0);
 
         explicit Storage(const Storage& other) = default;
         explicit Storage(Storage&& other) = default;
@@ -20,21 +46,76 @@ namespace st {
 
         Storage& operator=(const Storage& other) = delete;
 
-        data_t operator[](index_t idx) const { return f_ptr[idx]; }
-        data_t& operator[](index_t idx) { return f_ptr[idx]; }
-        [[nodiscard]] index_t offset() const { return f_ptr - b_ptr->data_; }
-        // index_t version() const { return b_ptr->version; }
-        // void increment_version() { ++b_ptr->version; }
+        data_t operator[](index_t idx) const { return load(raw(), dtype_, idx); }
+        ElementRef operator[](index_t idx);
+        // pointer to the first element, offset included
+        [[nodiscard]] const void* raw() const {
+            return reinterpret_cast<const char*>(b_ptr->buffer->data_) + offset_*dtype_size(dtype_);
+        }
+        void* raw() {
+            if (!b_ptr->writable) refuse_write();
+            if (b_ptr->buffer.use_count() > 1 || b_ptr->read_only) detach();
+            ++b_ptr->version;
+            return reinterpret_cast<char*>(b_ptr->buffer->data_) + offset_*dtype_size(dtype_);
+        }
+        // typed access, T has to be the element type of dtype()
+        template<typename T = data_t>
+        [[nodiscard]] const T* data() const { return static_cast<const T*>(raw()); }
+        template<typename T = data_t>
+        T* data() { return static_cast<T*>(raw()); }
+        [[nodiscard]] DType dtype() const { return dtype_; }
+        [[nodiscard]] index_t offset() const { return offset_; }
+        [[nodiscard]] bool is_shared_with(const Storage& other) const { return b_ptr == other.b_ptr; }
+        [[nodiscard]] Storage copy() const;
+        [[nodiscard]] index_t version() const { return b_ptr->version; }
         index_t size_;
     private:
         struct Data {
-            // index_t version_; // what is its meaning?
             data_t data_[1];
         };
-        std::shared_ptr<Data> b_ptr; // base pointer
-        data_t* f_ptr; // float pointer
+        struct Block {
+            index_t version;
+            std::shared_ptr<Data> buffer;
+            bool read_only = false; // buffer must not be written in place, e.g. a copy of a read-only mapping
+            bool writable = true;   // false for a read-only mapping itself: writes throw instead of detaching
+            bool foreign = false;   // buffer belongs to the caller (from_blob) and is never detached
+        };
+        Storage(const std::shared_ptr<Data>& buffer, index_t size, index_t offset, DType dtype,
+                bool read_only = false, bool writable = true, bool foreign = false);
+        void detach();
+        [[noreturn]] void refuse_write() const;
+
+        std::shared_ptr<Block> b_ptr; // base pointer
+        index_t offset_;
+        DType dtype_;
     };
 
+    // reference to one element of a storage of any dtype, read and written as
+    // data_t. Only writes go through the non-const raw(), so reading one does
+    // not detach a shared or mapped buffer. It shares the storage's Block, so
+    // it stays valid after the tensor it came from is gone.
+    class ElementRef {
+    public:
+        ElementRef(Storage& storage, index_t idx) : storage_(storage), idx_(idx) {}
+        ElementRef(const ElementRef& other) = default;
+
+        operator data_t() const { return std::as_const(storage_)[idx_]; }
+        ElementRef& operator=(data_t value) {
+            store(storage_.raw(), storage_.dtype(), idx_, value);
+            return *this;
+        }
+        ElementRef& operator=(const ElementRef& other) { return *this = static_cast<data_t>(other); }
+        ElementRef& operator+=(data_t value) { return *this = *this + value; }
+        ElementRef& operator-=(data_t value) { return *this = *this - value; }
+        ElementRef& operator*=(data_t value) { return *this = *this * value; }
+        ElementRef& operator/=(data_t value) { return *this = *this / value; }
+    private:
+        Storage storage_;
+        index_t idx_;
+    };
+
+    inline ElementRef Storage::operator[](index_t idx) { return ElementRef(*this, idx); }
+
 } // SimpleTensor
 
 #endif //TENSOR_STORAGE_H
@@ -2,10 +2,18 @@
 #define TENSOR_TENSOR_H
 
 #include "tensor_impl.h"
+#include "accessor.h"
+#include "iterator.h"
 #include "exp.h"
 #include "oper.h"
 #include "allocator.h"
 
+#include <compare>
+#include <iterator>
+#include <ranges>
+#include <span>
+#include <vector>
+
 namespace st {
 
     class Tensor : public Exp<TensorImpl>
@@ -15,23 +23,19 @@ namespace st {
 		//constructors
 		Tensor(const Storage& storage, const Shape& shape, const IndexArray& stride);
 		Tensor(const Storage& storage, const Shape& shape);
-		explicit Tensor(const Shape& shape);
+		explicit Tensor(const Shape& shape, DType dtype = DType::Float64);
 		Tensor(const data_t* data, const Shape& shape);
 		Tensor(Storage&& storage, Shape&& shape, IndexArray&& stride);
+		// copies and copy assignment refer to the same tensor as other, so
+		// writes through either are seen by both; clone() makes a separate one
 		Tensor(const Tensor& other) = default;
 		Tensor(Tensor&& other) = default;
-		Tensor& operator=(const Tensor &other)
-        {
-			if (this != &other) {
-				impl_ptr = Alloc::unique_construct<TensorImpl>(*other.impl_ptr);
-			}
-			return *this;
-		}
+		Tensor& operator=(const Tensor &other) = default;
 		Tensor& operator=(Tensor &&other) = default;
         ~Tensor() = default;
 		explicit Tensor(Alloc::NonTrivalUniquePtr<TensorImpl>&& ptr);
         template<typename ImplType>
-        Tensor(const Exp<ImplType>& impl) : Tensor(impl.ptr()->size())
+        Tensor(const Exp<ImplType>& impl) : Tensor(empty(impl.ptr()->size(), impl.ptr()->dtype()))
         {
             impl_ptr->operator=(impl.ptr());
         }
@@ -43,99 +47,245 @@ namespace st {
 		[[nodiscard]] const Shape& size() const { return impl_ptr->size(); }
 		[[nodiscard]] index_t offset() const { return impl_ptr->offset(); }
 		[[nodiscard]] const IndexArray& stride() const { return impl_ptr->stride(); }
+		[[nodiscard]] index_t version() const { return impl_ptr->version(); }
+		[[nodiscard]] DType dtype() const { return impl_ptr->dtype(); }
 
 		//methods
 		[[nodiscard]] bool is_contiguous();
 		[[nodiscard]] data_t item() const;
-		[[nodiscard]] data_t item(int idx) const;
-		[[nodiscard]] data_t eval(IndexArray idx) const;
-		data_t &operator[](std::initializer_list<index_t> dims);
+		[[nodiscard]] data_t item(index_t idx) const;
+		[[nodiscard]] data_t eval(const IndexArray& idx) const;
+		ElementRef operator[](std::initializer_list<index_t> dims);
 		data_t operator[](std::initializer_list<index_t> dims) const;
 
+		[[nodiscard]] Tensor clone() const; // copy-on-write, shares the data until either side writes
+		[[nodiscard]] Tensor to(DType dtype) const;
+		// this tensor when it is contiguous already, a row-major copy otherwise
+		[[nodiscard]] Tensor contiguous() const;
 		[[nodiscard]] Tensor slice(index_t idx, index_t dim = 0) const;
 		[[nodiscard]] Tensor slice(index_t start, index_t end, index_t dim) const;
+		[[nodiscard]] Tensor slice(std::optional<int64_t> start, std::optional<int64_t> end, int64_t step, index_t dim) const;
+		[[nodiscard]] Tensor slice(std::initializer_list<Slice> ranges) const;
 		[[nodiscard]] Tensor transpose(index_t dim1, index_t dim2) const;
 		[[nodiscard]] Tensor view(const Shape& Shape) const;
+		[[nodiscard]] Tensor reshape(const Shape& Shape) const;
 		[[nodiscard]] Tensor permute(std::initializer_list<index_t> dims) const;
+		[[nodiscard]] Tensor expand(const Shape& shape) const;
+		[[nodiscard]] Tensor broadcast_to(const Shape& shape) const { return expand(shape); }
+		[[nodiscard]] Tensor squeeze() const;
+		[[nodiscard]] Tensor squeeze(index_t dim) const;
+		[[nodiscard]] Tensor unsqueeze(index_t dim) const;
         [[nodiscard]] Tensor sum(int idx) const;
+		Tensor& sum(int idx, Tensor& out) const;
+
+		// typed access without per-element checks, see accessor.h; dtype and rank
+		// are checked here once. The non-const one makes the storage writable,
+		// detaching a shared buffer, before handing out the pointer.
+		template<typename T, index_t Rank>
+		[[nodiscard]] TensorAccessor<T, Rank> accessor() {
+			check_accessor(dtype_of<T>::value, Rank);
+			return TensorAccessor<T, Rank>(impl_ptr->storage().template data<T>(), size(), stride());
+		}
+		template<typename T, index_t Rank>
+		[[nodiscard]] TensorAccessor<const T, Rank> accessor() const {
+			check_accessor(dtype_of<T>::value, Rank);
+			return TensorAccessor<const T, Rank>(std::as_const(*impl_ptr).storage().template data<T>(), size(), stride());
+		}
 
 		//friend function
 		friend std::ostream& operator<<(std::ostream& out, const Tensor& tensor);
 
 		//iterator
+		// Random access iterators over the elements as data_t, in row-major order
+		// for any layout. Each step moves a StridedCursor, so it is cheap; for a
+		// known dtype, values() and elements() avoid the conversion as well.
 		class const_iterator
 		{
-		 private:
-			using const_reference = const data_t&;
-			using const_pointer = const data_t*;
-			std::vector<index_t> _idx;
-			const Tensor* _tensor;
 		 public:
-			const_iterator(const Tensor* tensor,std::vector<index_t> idx);
-			const_iterator(const const_iterator& other) = default;
-			const_iterator(const_iterator&& other) = default;
-			~const_iterator() = default;
-
-			const_iterator& operator=(const const_iterator& other) = default;
-			const_iterator& operator=(const_iterator&& other) = default;
-			const_iterator& operator++();
-			const_iterator operator++(int);
-			const_iterator& operator--();
-			const_iterator operator--(int);
-			index_t operator-(const const_iterator& other) const;
-			bool operator==(const const_iterator& other) const;
-			bool operator!=(const const_iterator& other) const;
-			const_reference operator*() const;
-			const_pointer operator->() const;
+			using iterator_concept = std::random_access_iterator_tag;
+			using iterator_category = std::random_access_iterator_tag;
+			using value_type = data_t;
+			using difference_type = std::ptrdiff_t;
+			using reference = data_t;
+			using pointer = void;
+
+			const_iterator() = default;
+			const_iterator(const Tensor* tensor, index_t pos)
+				: _impl(tensor->impl_ptr.get()), _cursor(&_impl->size(), &_impl->stride(), pos) {}
+
+			reference operator*() const { return std::as_const(*_impl).item(_cursor.offset()); }
+			reference operator[](difference_type n) const { return *(*this + n); }
+			const_iterator& operator++() { _cursor.next(); return *this; }
+			const_iterator operator++(int) { const_iterator tmp = *this; _cursor.next(); return tmp; }
+			const_iterator& operator--() { _cursor.prev(); return *this; }
+			const_iterator operator--(int) { const_iterator tmp = *this; _cursor.prev(); return tmp; }
+			const_iterator& operator+=(difference_type n) { _cursor.advance(n); return *this; }
+			const_iterator& operator-=(difference_type n) { _cursor.advance(-n); return *this; }
+			friend const_iterator operator+(const_iterator it, difference_type n) { return it += n; }
+			friend const_iterator operator+(difference_type n, const_iterator it) { return it += n; }
+			friend const_iterator operator-(const_iterator it, difference_type n) { return it -= n; }
+			friend difference_type operator-(const const_iterator& lhs, const const_iterator& rhs) {
+				return static_cast<difference_type>(lhs._cursor.pos() - rhs._cursor.pos());
+			}
+			friend bool operator==(const const_iterator& lhs, const const_iterator& rhs) {
+				return lhs._cursor.pos() == rhs._cursor.pos();
+			}
+			friend std::strong_ordering operator<=>(const const_iterator& lhs, const const_iterator& rhs) {
+				return lhs._cursor.pos() <=> rhs._cursor.pos();
+			}
+		 private:
+			const TensorImpl* _impl = nullptr;
+			StridedCursor _cursor;
 		};
 
 		class iterator
 		{
-		 private:
-			using reference = data_t&;
-			using pointer = data_t*;
 		 public:
-			iterator(Tensor* tensor,std::vector<index_t> idx);
-			iterator(const iterator& other) = default;
-			iterator(iterator&& other) = default;
-			~iterator() = default;
-			iterator& operator=(const iterator& other) = default;
-			iterator& operator=(iterator&& other) = default;
-			iterator& operator++();
-			iterator operator++(int);
-			iterator& operator--();
-			iterator operator--(int);
-			bool operator==(const iterator& other) const;
-			bool operator!=(const iterator& other) const;
-			reference operator*() const;
-			pointer operator->() const;
+			using iterator_concept = std::random_access_iterator_tag;
+			using iterator_category = std::random_access_iterator_tag;
+			using value_type = data_t;
+			using difference_type = std::ptrdiff_t;
+			using reference = ElementRef;
+			using pointer = void;
+
+			iterator() = default;
+			iterator(Tensor* tensor, index_t pos)
+				: _impl(tensor->impl_ptr.get()), _cursor(&_impl->size(), &_impl->stride(), pos) {}
+
+			reference operator*() const { return _impl->item(_cursor.offset()); }
+			reference operator[](difference_type n) const { return *(*this + n); }
+			iterator& operator++() { _cursor.next(); return *this; }
+			iterator operator++(int) { iterator tmp = *this; _cursor.next(); return tmp; }
+			iterator& operator--() { _cursor.prev(); return *this; }
+			iterator operator--(int) { iterator tmp = *this; _cursor.prev(); return tmp; }
+			iterator& operator+=(difference_type n) { _cursor.advance(n); return *this; }
+			iterator& operator-=(difference_type n) { _cursor.advance(-n); return *this; }
+			friend iterator operator+(iterator it, difference_type n) { return it += n; }
+			friend iterator operator+(difference_type n, iterator it) { return it += n; }
+			friend iterator operator-(iterator it, difference_type n) { return it -= n; }
+			friend difference_type operator-(const iterator& lhs, const iterator& rhs) {
+				return static_cast<difference_type>(lhs._cursor.pos() - rhs._cursor.pos());
+			}
+			friend bool operator==(const iterator& lhs, const iterator& rhs) {
+				return lhs._cursor.pos() == rhs._cursor.pos();
+			}
+			friend std::strong_ordering operator<=>(const iterator& lhs, const iterator& rhs) {
+				return lhs._cursor.pos() <=> rhs._cursor.pos();
+			}
 		 private:
-			std::vector<index_t> _idx;
-			Tensor* _tensor;
+			TensorImpl* _impl = nullptr;
+			StridedCursor _cursor;
 		};
 
-		[[nodiscard]] const_iterator begin() const;
-		[[nodiscard]] const_iterator end() const;
-		[[nodiscard]] iterator begin();
-		[[nodiscard]] iterator end();
+		[[nodiscard]] const_iterator begin() const { return const_iterator(this, 0); }
+		[[nodiscard]] const_iterator end() const { return const_iterator(this, d_size()); }
+		[[nodiscard]] iterator begin() { return iterator(this, 0); }
+		[[nodiscard]] iterator end() { return iterator(this, d_size()); }
+
+		// The elements of a contiguous tensor of element type T as one span, so
+		// that loops and std algorithms run over plain pointers. The non-const one
+		// makes the storage writable first, as accessor() does.
+		template<typename T>
+		[[nodiscard]] std::span<T> values() {
+			check_values(dtype_of<T>::value, true);
+			return std::span<T>(impl_ptr->storage().template data<T>(), d_size());
+		}
+		template<typename T>
+		[[nodiscard]] std::span<const T> values() const {
+			check_values(dtype_of<T>::value, true);
+			return std::span<const T>(std::as_const(*impl_ptr).storage().template data<T>(), d_size());
+		}
+		// the elements of any layout as T, in row-major order
+		template<typename T>
+		[[nodiscard]] std::ranges::subrange<StridedIterator<T>> elements() {
+			check_values(dtype_of<T>::value, false);
+			T* data = impl_ptr->storage().template data<T>();
+			return {StridedIterator<T>(data, &size(), &stride(), 0),
+			        StridedIterator<T>(data, &size(), &stride(), d_size())};
+		}
+		template<typename T>
+		[[nodiscard]] std::ranges::subrange<StridedIterator<const T>> elements() const {
+			check_values(dtype_of<T>::value, false);
+			const T* data = std::as_const(*impl_ptr).storage().template data<T>();
+			return {StridedIterator<const T>(data, &size(), &stride(), 0),
+			        StridedIterator<const T>(data, &size(), &stride(), d_size())};
+		}
 
 		template<typename ImplType>
 		Tensor& operator=(const Exp<ImplType>& src_){
             impl_ptr->operator=(src_.ptr());
 			return *this;
 		}
+		template<typename ImplType>
+		Tensor& operator+=(const Exp<ImplType>& src_){
+            impl_ptr->template compound_assign<op::Add>(src_.ptr());
+			return *this;
+		}
+		template<typename ImplType>
+		Tensor& operator-=(const Exp<ImplType>& src_){
+            impl_ptr->template compound_assign<op::Sub>(src_.ptr());
+			return *this;
+		}
+		template<typename ImplType>
+		Tensor& operator*=(const Exp<ImplType>& src_){
+            impl_ptr->template compound_assign<op::Mul>(src_.ptr());
+			return *this;
+		}
+		template<typename ImplType>
+		Tensor& operator/=(const Exp<ImplType>& src_){
+            impl_ptr->template compound_assign<op::Div>(src_.ptr());
+			return *this;
+		}
+		Tensor& operator+=(data_t value);
+		Tensor& operator-=(data_t value);
+		Tensor& operator*=(data_t value);
+		Tensor& operator/=(data_t value);
 
-        static Tensor ones(const Shape& shape);
+        static Tensor empty(const Shape& shape, DType dtype = DType::Float64);
+        static Tensor ones(const Shape& shape, DType dtype = DType::Float64);
         static Tensor ones_like(const Tensor& tensor);
-        static Tensor zeros(const Shape& shape);
+        static Tensor zeros(const Shape& shape, DType dtype = DType::Float64);
         static Tensor zeros_like(const Tensor& tensor);
-        static Tensor rand(const Shape& shape);
+        static Tensor rand(const Shape& shape, DType dtype = DType::Float64);
         static Tensor rand_like(const Tensor& tensor);
-        static Tensor randn(const Shape& shape);
+        static Tensor randn(const Shape& shape, DType dtype = DType::Float64);
         static Tensor randn_like(const Tensor& tensor);
+        // a tensor over memory owned by the caller, without copying it. Writes
+        // go to that memory, and clone() copies it out at once; release(data)
+        // runs when the last tensor or view over it is destroyed. Strides must
+        // not be negative.
+        static Tensor from_blob(void* data, const Shape& shape, const IndexArray& stride,
+                                std::function<void(void*)> release = {}, DType dtype = DType::Float64);
+        static Tensor from_blob(void* data, const Shape& shape,
+                                std::function<void(void*)> release = {}, DType dtype = DType::Float64);
+        // a contiguous tensor over a memory-mapped file region starting at byte offset
+        static Tensor map_file(const std::string& path, const Shape& shape, DType dtype = DType::Float64,
+                               MapMode mode = MapMode::ReadOnly, index_t offset = 0);
         [[nodiscard]] data_t sum() const;
+
+	 private:
+		void check_accessor(DType dtype, index_t rank) const;
+		void check_values(DType dtype, bool contiguous) const;
     };
 
+	// evaluates expr straight into out (which may be a view) without allocating
+	// a result tensor; out must already have the shape of expr.
+	template<typename ImplType>
+	Tensor& eval_into(Tensor& out, const Exp<ImplType>& expr)
+	{
+		CHECK_EXP_SAME_SHAPE(out, expr.self());
+		return out = expr;
+	}
+
+	// joins tensors of one dtype along dimension dim, where their other sizes
+	// must agree. The out overloads write into a preallocated tensor of the
+	// joined shape; contiguous parts are moved with bulk memcpys.
+	Tensor cat(const std::vector<Tensor>& tensors, index_t dim = 0);
+	Tensor& cat(const std::vector<Tensor>& tensors, index_t dim, Tensor& out);
+	// joins tensors of one shape along a new dimension dim
+	Tensor stack(const std::vector<Tensor>& tensors, index_t dim = 0);
+	Tensor& stack(const std::vector<Tensor>& tensors, index_t dim, Tensor& out);
+
 } // st
 
 #endif //TENSOR_TENSOR_H
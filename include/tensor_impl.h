@@ -7,22 +7,37 @@
 #include "allocator.h"
 #include "exception.h"
 #include "exp.h"
+#include "loop.h"
 
 #include <initializer_list>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace st {
+    // a Python style range over one dimension: negative bounds count from the
+    // back, missing ones cover the dimension in the direction of step
+    struct Slice {
+        std::optional<int64_t> start, end;
+        int64_t step = 1;
+    };
+
     class TensorImpl {
     public:
         // constructor
         TensorImpl(const Storage& Storage, const Shape& Shape, const IndexArray& stride);
         TensorImpl(const Storage& Storage, const Shape& Shape);
-        explicit TensorImpl(const Shape& Shape);
+        explicit TensorImpl(const Shape& Shape, DType dtype = DType::Float64);
         TensorImpl(const data_t* data, const Shape& Shape);
         TensorImpl(Storage&& Storage, Shape&& Shape, IndexArray&& stride);
         TensorImpl(const TensorImpl& other) = default;
         TensorImpl(TensorImpl&& other) = default;
         template<typename ImplType>
-        explicit TensorImpl(const ImplType& impl) : TensorImpl(impl->size()) {
+        explicit TensorImpl(const ImplType& impl) :
+            TensorImpl(Storage(impl->size().d_size(), impl->dtype()), impl->size()) {
             this->operator=(impl);
         }
 
@@ -30,72 +45,208 @@ namespace st {
         [[nodiscard]] index_t n_dim() const { return _shape.n_dim(); }
         [[nodiscard]] index_t d_size() const { return  _shape.d_size(); }
         [[nodiscard]] index_t size(index_t idx) const {
-            CHECK_IN_RANGE(idx, 0, n_dim(), "Index out of range (expected to be in range of [0, %d), but got %d)",
-                           n_dim(), idx);
+            CHECK_TRUE(idx < n_dim(), "Index out of range (expected to be in range of [0, %zu), but got %zu)",
+                       n_dim(), idx);
             return _shape[idx];
         }
         [[nodiscard]] const Shape& size() const { return _shape; }
         [[nodiscard]] index_t offset() const { return _storage.offset(); }
         [[nodiscard]] const IndexArray& stride() const { return _stride; }
+        [[nodiscard]] index_t version() const { return _storage.version(); }
+        [[nodiscard]] DType dtype() const { return _storage.dtype(); }
+        [[nodiscard]] const Storage& storage() const { return _storage; }
+        [[nodiscard]] Storage& storage() { return _storage; }
 
         // methods
         bool is_contiguous() const;
+        [[nodiscard]] index_t extent() const; // largest index from offset() any element sits at
+        [[nodiscard]] index_t back_extent() const; // how far before offset() negative strides reach
 
-        data_t& operator[](std::initializer_list<index_t> dims); // use initializer list to access/modify the data.
+        ElementRef operator[](std::initializer_list<index_t> dims); // use initializer list to access/modify the data.
         data_t operator[](std::initializer_list<index_t> dims) const;
         [[nodiscard]] data_t item() const;
         [[nodiscard]] data_t item(index_t idx) const;
-		[[nodiscard]] data_t& item(index_t idx);
-        [[nodiscard]] data_t eval(IndexArray idx) const;
+		[[nodiscard]] ElementRef item(index_t idx);
+        [[nodiscard]] data_t eval(const IndexArray& idx) const;
         [[nodiscard]] data_t sum() const;
+        [[nodiscard]] bool is_flat(const Shape& shape) const;
+        [[nodiscard]] bool overlaps(const TensorImpl& dst, bool elementwise = true) const;
+        [[nodiscard]] const data_t* eval_block(index_t start, index_t n, data_t* buf) const;
 
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> clone() const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> to(DType dtype) const;
+        // row-major copy, made by a tiled strided copy rather than element by element
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> contiguous() const;
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> slice(index_t idx, index_t dim = 0) const;
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> slice(index_t start_idx, index_t end_idx, index_t dim) const;
+        // views only: the offset moves to the first element and the stride is scaled by step
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> slice(const Slice& range, index_t dim) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> slice(std::initializer_list<Slice> ranges) const; // from dim 0
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> transpose(index_t dim1, index_t dim2) const;
+        // shares the storage; fails when shape cannot be laid over the current strides
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> view(const Shape& Shape) const;
+        // a view when possible, a view of a contiguous copy otherwise
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> reshape(const Shape& Shape) const;
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> permute(std::initializer_list<index_t> dims) const;
+        // size 1 dimensions repeated to shape by a zero stride, new ones in front
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> expand(const Shape& shape) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> squeeze() const; // drops every size 1 dimension
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> squeeze(index_t dim) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> unsqueeze(index_t dim) const;
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> sum(int idx) const;
+        void sum(int idx, TensorImpl& out) const;
 
         // friend function
         friend std::ostream& operator<<(std::ostream& out, const TensorImpl& tensor);
 
         template<typename ImplType>
         TensorImpl& operator=(const ImplType& src) {
-            std::vector<index_t> dim_cnt(n_dim(), 0);
-            int cnt = 0;
-            while (cnt < d_size()) {
-                int idx = 0;
-                for (int i = 0; i < n_dim(); ++i) {
-                    idx += dim_cnt[i] * _stride[i];
+            if (src->overlaps(*this)) {
+                // src reads elements this loop writes earlier, so stage it
+                TensorImpl tmp(Storage(d_size()), _shape);
+                tmp = src;
+                return *this = &tmp;
+            }
+            dispatch(dtype(), [&]<typename T>() {
+                T* dst = _storage.data<T>();
+                if (is_contiguous() && src->is_flat(_shape)) {
+                    data_t buf[BLOCK_SIZE];
+                    for (index_t start = 0; start < d_size(); start += BLOCK_SIZE) {
+                        index_t n = std::min(BLOCK_SIZE, d_size()-start);
+                        if constexpr (std::is_same_v<T, data_t>) {
+                            const data_t* res = src->eval_block(start, n, dst+start);
+                            if (res != dst+start) std::memmove(dst+start, res, n*sizeof(data_t));
+                        } else {
+                            store_block(src->eval_block(start, n, buf), dst+start, n);
+                        }
+                    }
+                    return;
                 }
-                item(idx) = src->eval(dim_cnt);
-                for (int i = n_dim()-1; i >= 0; --i) {
+                if constexpr (std::is_convertible_v<ImplType, const TensorImpl*>) {
+                    if (src->_shape == _shape) {
+                        copy_from<T>(dst, *src);
+                        return;
+                    }
+                }
+                for_each_index([&](const IndexArray& dim_cnt, auto idx) {
+                    dst[idx] = from_data<T>(src->eval(dim_cnt));
+                });
+            });
+            return *this;
+        }
+
+        // in-place dst = Op::apply(dst, src)
+        template<typename Op, typename ImplType>
+        TensorImpl& compound_assign(const ImplType& src) {
+            if (src->overlaps(*this)) {
+                // src reads elements this loop writes earlier, so stage it
+                TensorImpl tmp(Storage(d_size()), _shape);
+                tmp = src;
+                return compound_assign<Op>(&tmp);
+            }
+            dispatch(dtype(), [&]<typename T>() {
+                T* dst = _storage.data<T>();
+                if (is_contiguous() && src->is_flat(_shape)) {
+                    data_t buf[BLOCK_SIZE];
+                    for (index_t start = 0; start < d_size(); start += BLOCK_SIZE) {
+                        index_t n = std::min(BLOCK_SIZE, d_size()-start);
+                        const data_t* res = src->eval_block(start, n, buf);
+                        for (index_t i = 0; i < n; ++i)
+                            dst[start+i] = from_data<T>(Op::apply(to_data(dst[start+i]), res[i]));
+                    }
+                    return;
+                }
+                for_each_index([&](const IndexArray& dim_cnt, auto idx) {
+                    dst[idx] = from_data<T>(Op::apply(to_data(dst[idx]), src->eval(dim_cnt)));
+                });
+            });
+            return *this;
+        }
+
+        template<typename Op>
+        TensorImpl& compound_assign(data_t value) {
+            dispatch(dtype(), [&]<typename T>() {
+                T* dst = _storage.data<T>();
+                LoopNest<1> loop = make_loop<1>(_shape, {&_stride});
+                index_t cols = loop.cols(), step = loop.stride[0].back();
+                for_each_row(loop, [&](const auto& offset) {
+                    T* row = dst + offset[0];
+                    for (index_t i = 0; i < cols; ++i)
+                        row[i*step] = from_data<T>(Op::apply(to_data(row[i*step]), value));
+                });
+            });
+            return *this;
+        }
+
+    protected:
+        // strides that lay shape over the elements of this tensor without moving
+        // them, false when there are none
+        bool view_stride(const Shape& shape, IndexArray& stride) const;
+
+        // dst = src for a src of the same shape, in rows of the loop nest
+        // over both layouts
+        template<typename T>
+        void copy_from(T* dst, const TensorImpl& src) {
+            LoopNest<2> loop = make_loop<2>(_shape, {&_stride, &src._stride});
+            index_t cols = loop.cols(), dst_step = loop.stride[0].back(), src_step = loop.stride[1].back();
+            dispatch(src.dtype(), [&]<typename U>() {
+                const U* from = src._storage.data<U>();
+                for_each_row(loop, [&](const auto& offset) {
+                    T* row = dst + offset[0];
+                    const U* src_row = from + offset[1];
+                    for (index_t i = 0; i < cols; ++i) {
+                        if constexpr (std::is_same_v<T, U>) row[i*dst_step] = src_row[i*src_step];
+                        else row[i*dst_step] = from_data<T>(to_data(src_row[i*src_step]));
+                    }
+                });
+            });
+        }
+
+        // calls f(dim_cnt, idx) for every element, idx being the element's
+        // index from offset(). The loops nest in stride_order(), so the
+        // dimension with the smallest stride is stepped innermost. idx is
+        // stepped incrementally, in index32_t when every reachable index fits
+        // in 32 bits and none lies before offset().
+        template<typename F>
+        void for_each_index(F&& f) const {
+            if (extent() <= UINT32_MAX && back_extent() == 0) for_each_index<index32_t>(f);
+            else for_each_index<index_t>(f);
+        }
+        template<typename I, typename F>
+        void for_each_index(F& f) const {
+            std::vector<index_t> order = stride_order(_shape, _stride);
+            IndexArray dim_cnt(n_dim());
+            dim_cnt.memset(0);
+            I idx = 0;
+            for (index_t cnt = 0; cnt < d_size(); ++cnt) {
+                f(std::as_const(dim_cnt), idx);
+                for (index_t k = n_dim(); k-- > 0;) {
+                    index_t i = order[k];
                     if (dim_cnt[i]+1 < _shape[i]) {
                         dim_cnt[i]++;
+                        idx += (I)_stride[i];
                         break;
-                    } else {
-                        dim_cnt[i] = 0;
                     }
+                    idx -= (I)(dim_cnt[i] * _stride[i]);
+                    dim_cnt[i] = 0;
                 }
-                ++cnt;
             }
-            return *this;
         }
 
-    protected:
         Storage _storage;
         Shape _shape;
         IndexArray _stride;
     };
 
     struct TensorMaker {
-        static TensorImpl ones(const Shape& shape);
+        static TensorImpl empty(const Shape& shape, DType dtype = DType::Float64); // storage left uninitialized
+        static TensorImpl ones(const Shape& shape, DType dtype = DType::Float64);
         static TensorImpl ones_like(const TensorImpl& tensor);
-        static TensorImpl zeros(const Shape& shape);
+        static TensorImpl zeros(const Shape& shape, DType dtype = DType::Float64);
         static TensorImpl zeros_like(const TensorImpl& tensor);
-        static TensorImpl rand(const Shape& shape);
+        static TensorImpl rand(const Shape& shape, DType dtype = DType::Float64);
         static TensorImpl rand_like(const TensorImpl& tensor);
-        static TensorImpl randn(const Shape& shape);
+        static TensorImpl randn(const Shape& shape, DType dtype = DType::Float64);
         static TensorImpl randn_like(const TensorImpl& tensor);
     };
 } // st
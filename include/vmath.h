@@ -0,0 +1,53 @@
+#ifndef TENSOR_VMATH_H
+#define TENSOR_VMATH_H
+
+// vectorized transcendental functions used by the elementwise ops
+
+#include "storage.h"
+
+namespace st {
+    namespace vmath {
+        // Accurate (default): range reduction carried in double-double and
+        // fdlibm-style minimax kernels. Max error against a long double
+        // reference, measured on random samples spread over the whole double
+        // range (tensorCalcOperatorTest.transcendentalUlp checks these):
+        //     sin, cos, exp, log      < 1 ulp
+        //     tan, tanh, sigmoid      < 3 ulp
+        // nan, inf, overflow, underflow and subnormal inputs behave like <cmath>;
+        // sin/cos/tan fall back to the libm call for |x| > 2^19*pi/2.
+        //
+        // Fast: for inference, drops the extra-precision reduction terms and all
+        // special-case handling. Max error stays below 3 ulp (sin, cos < 2 ulp)
+        // on the ranges
+        //     sin, cos, tan     |x| < 1e5
+        //     exp, sigmoid      |x| < 708
+        //     log               positive normal x
+        //     tanh              |x| < 354
+        // and the result is unspecified outside of them.
+        enum class Precision { Accurate, Fast };
+
+        // process wide; other threads pick a change up on their next call
+        void set_precision(Precision precision);
+        Precision precision();
+
+        // scalar versions, used by the per-element eval() path
+        data_t sin(data_t x);
+        data_t cos(data_t x);
+        data_t tan(data_t x);
+        data_t exp(data_t x);
+        data_t log(data_t x);
+        data_t tanh(data_t x);
+        data_t sigmoid(data_t x);
+
+        // array versions, src and dst may be the same buffer
+        void sin(const data_t* src, data_t* dst, index_t n);
+        void cos(const data_t* src, data_t* dst, index_t n);
+        void tan(const data_t* src, data_t* dst, index_t n);
+        void exp(const data_t* src, data_t* dst, index_t n);
+        void log(const data_t* src, data_t* dst, index_t n);
+        void tanh(const data_t* src, data_t* dst, index_t n);
+        void sigmoid(const data_t* src, data_t* dst, index_t n);
+    } // vmath
+} // st
+
+#endif //TENSOR_VMATH_H
@@ -11,6 +11,7 @@ namespace st {
     }
 
     void* Alloc::allocate(index_t size) {
+        std::lock_guard<std::mutex> lock(self().mutex_);
         auto iter = self().cache_.find(size);
         void* res;
         if (iter != self().cache_.end()) {
@@ -27,11 +28,13 @@ namespace st {
     }
 
     void Alloc::deallocate(void* ptr, index_t size) {
+        std::lock_guard<std::mutex> lock(self().mutex_);
         deallocate_memory_size -= size;
         self().cache_.emplace(size, ptr);
     }
 
     bool Alloc::all_clear() {
+        std::lock_guard<std::mutex> lock(self().mutex_);
         return deallocate_memory_size == allocate_memory_size;
     }
 }
\ No newline at end of file
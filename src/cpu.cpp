@@ -0,0 +1,32 @@
+#include "cpu.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace st {
+    namespace cpu {
+        namespace {
+            Isa detect() {
+#ifdef ST_X86_DISPATCH
+                __builtin_cpu_init();
+                if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma") ||
+                    !__builtin_cpu_supports("f16c")) return Isa::Baseline;
+                if (!__builtin_cpu_supports("avx512f") || !__builtin_cpu_supports("avx512bw")) return Isa::AVX2;
+                if (!__builtin_cpu_supports("avx512vnni")) return Isa::AVX512;
+                return Isa::AVX512VNNI;
+#else
+                return Isa::Baseline;
+#endif
+            }
+
+            std::atomic<Isa> max_isa{Isa::AVX512VNNI};
+        }
+
+        Isa isa() {
+            static const Isa detected = detect();
+            return std::min(detected, max_isa.load(std::memory_order_relaxed));
+        }
+
+        void set_max_isa(Isa isa) { max_isa.store(isa, std::memory_order_relaxed); }
+    } // cpu
+} // st
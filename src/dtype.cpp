@@ -0,0 +1,93 @@
+#include "dtype.h"
+#include "cpu.h"
+#include "exception.h"
+
+#include <algorithm>
+
+#ifdef ST_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace st {
+    namespace {
+#ifdef ST_X86_DISPATCH
+        // the leading multiple of 8 elements, returning how many were done
+        __attribute__((target("avx,f16c")))
+        index_t convert_f16c(const float16* src, float* dst, index_t n) {
+            index_t i = 0;
+            for (; i + 8 <= n; i += 8)
+                _mm256_storeu_ps(dst+i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src+i))));
+            return i;
+        }
+
+        __attribute__((target("avx,f16c")))
+        index_t convert_f16c(const float* src, float16* dst, index_t n) {
+            index_t i = 0;
+            for (; i + 8 <= n; i += 8)
+                _mm_storeu_si128((__m128i*)(dst+i), _mm256_cvtps_ph(_mm256_loadu_ps(src+i), _MM_FROUND_TO_NEAREST_INT));
+            return i;
+        }
+#endif
+    }
+
+    void inexact_int64(data_t value) {
+        THROW_ERROR("%.17g is outside of the int64 range evaluated exactly, [-2^53, 2^53]", value);
+    }
+
+    index_t dtype_size(DType dtype) {
+        return dispatch(dtype, []<typename T>() { return (index_t)sizeof(T); });
+    }
+
+    const char* dtype_name(DType dtype) {
+        switch (dtype) {
+            case DType::Int8: return "int8";
+            case DType::UInt8: return "uint8";
+            case DType::Int32: return "int32";
+            case DType::Int64: return "int64";
+            case DType::BFloat16: return "bfloat16";
+            case DType::Float16: return "float16";
+            case DType::Float32: return "float32";
+            default: return "float64";
+        }
+    }
+
+    bool is_floating(DType dtype) {
+        return dtype >= DType::BFloat16;
+    }
+
+    DType promote_types(DType lhs, DType rhs) {
+        if (std::min(lhs, rhs) == DType::Int8 && std::max(lhs, rhs) == DType::UInt8)
+            return DType::Int32;
+        if (std::min(lhs, rhs) == DType::BFloat16 && std::max(lhs, rhs) == DType::Float16)
+            return DType::Float32;
+        return std::max(lhs, rhs);
+    }
+
+    void convert(const bfloat16* src, float* dst, index_t n) {
+        for (index_t i = 0; i < n; ++i)
+            dst[i] = src[i];
+    }
+
+    void convert(const float* src, bfloat16* dst, index_t n) {
+        for (index_t i = 0; i < n; ++i)
+            dst[i] = bfloat16(src[i]);
+    }
+
+    void convert(const float16* src, float* dst, index_t n) {
+        index_t i = 0;
+#ifdef ST_X86_DISPATCH
+        if (cpu::isa() >= cpu::Isa::AVX2) i = convert_f16c(src, dst, n);
+#endif
+        for (; i < n; ++i)
+            dst[i] = src[i];
+    }
+
+    void convert(const float* src, float16* dst, index_t n) {
+        index_t i = 0;
+#ifdef ST_X86_DISPATCH
+        if (cpu::isa() >= cpu::Isa::AVX2) i = convert_f16c(src, dst, n);
+#endif
+        for (; i < n; ++i)
+            dst[i] = float16(src[i]);
+    }
+} // st
@@ -0,0 +1,194 @@
+#include "indexing.h"
+#include "exception.h"
+#include "parallel.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace st {
+    namespace {
+        // the entries of index in row-major order, checked to lie in [0, bound)
+        std::vector<index_t> read_index(const Tensor& index, index_t bound) {
+            CHECK_TRUE(!is_floating(index.dtype()),
+                "Expected an integer index tensor, but got %s", dtype_name(index.dtype()));
+            Tensor data = index.contiguous();
+            std::vector<index_t> res(index.d_size());
+            dispatch(index.dtype(), [&]<typename T>() {
+                if constexpr (std::is_integral_v<T>) {
+                    const T* ptr = std::as_const(*data.ptr()).storage().data<T>();
+                    for (index_t i = 0; i < res.size(); ++i) {
+                        CHECK_TRUE(ptr[i] >= 0 && (index_t)ptr[i] < bound,
+                            "Index %lld is out of bounds for dimension with size %zu", (long long)ptr[i], bound);
+                        res[i] = ptr[i];
+                    }
+                }
+            });
+            return res;
+        }
+
+        // offset of row (an index into every dimension but the last of shape) in
+        // a tensor of strides stride, leaving out dimension skip
+        index_t row_offset(const Shape& shape, const IndexArray& stride, index_t row, index_t skip) {
+            index_t res = 0;
+            for (index_t d = shape.n_dim()-1; d-- > 0; row /= shape[d])
+                if (d != skip) res += row % shape[d] * stride[d];
+            return res;
+        }
+
+        void check_index_shape(const char* name, const Tensor& self, index_t dim, const Tensor& index) {
+            CHECK_IN_RANGE(dim, 0, self.n_dim(),
+                "Dimension out of range (expected to be in range of [0, %zu), but got %zu)", self.n_dim(), dim);
+            CHECK_EQUAL(index.n_dim(), self.n_dim(),
+                "%s() expects an index of %zu dimensions, but got %zu", name, self.n_dim(), index.n_dim());
+            for (index_t d = 0; d < self.n_dim(); ++d)
+                CHECK_TRUE(d == dim || index.size(d) <= self.size(d),
+                    "Index size %zu is larger than size %zu in dimension %zu", index.size(d), self.size(d), d);
+        }
+
+        template<typename T>
+        T add(T lhs, T rhs) {
+            if constexpr (std::is_arithmetic_v<T>) return lhs + rhs;
+            else return static_cast<T>(static_cast<float>(lhs) + static_cast<float>(rhs));
+        }
+
+        template<bool Add>
+        Tensor& scatter_impl(Tensor& self, index_t dim, const Tensor& index, const Tensor& src, bool deterministic) {
+            const char* name = Add ? "scatter_add" : "scatter";
+            check_index_shape(name, self, dim, index);
+            check_index_shape(name, src, dim, index);
+            CHECK_TRUE(index.size(dim) <= src.size(dim),
+                "Index size %zu is larger than size %zu in dimension %zu", index.size(dim), src.size(dim), dim);
+            CHECK_TRUE(self.dtype() == src.dtype(),
+                "%s() expects src to be %s, but got %s", name, dtype_name(self.dtype()), dtype_name(src.dtype()));
+            if (index.d_size() == 0) return self;
+            std::vector<index_t> idx = read_index(index, self.size(dim));
+            // a source sharing memory with self is read from a copy
+            Tensor from = src.ptr()->overlaps(*self.ptr(), false) ? src.to(src.dtype()) : src;
+
+            const Shape& shape = index.size();
+            index_t n = shape.n_dim(), cols = shape[n-1], rows = index.d_size() / cols;
+            const IndexArray& stride = self.ptr()->stride();
+            const IndexArray& src_stride = from.ptr()->stride();
+            index_t col_stride = dim == n-1 ? 0 : stride[n-1], dim_stride = stride[dim];
+            dispatch(self.dtype(), [&]<typename T>() {
+                const T* src_ptr = std::as_const(*from.ptr()).storage().data<T>();
+                T* dst_ptr = self.ptr()->storage().data<T>();
+                auto run = [&](index_t r_begin, index_t r_end, index_t k_begin, index_t k_end) {
+                    for (index_t r = r_begin; r < r_end; ++r) {
+                        T* dst = dst_ptr + row_offset(shape, stride, r, dim);
+                        const T* src_row = src_ptr + row_offset(shape, src_stride, r, n);
+                        const index_t* row_idx = &idx[r*cols];
+                        for (index_t k = k_begin; k < k_end; ++k) {
+                            T& res = dst[k*col_stride + row_idx[k]*dim_stride];
+                            if constexpr (Add) res = add(res, src_row[k*src_stride[n-1]]);
+                            else res = src_row[k*src_stride[n-1]];
+                        }
+                    }
+                };
+
+                // Positions that differ in a coordinate other than dim write to
+                // different elements, so threads split such a coordinate and
+                // each position sees its writes in index order.
+                if (n == 1) {
+                    constexpr bool atomic_add = Add && (std::is_arithmetic_v<T>);
+                    if constexpr (atomic_add) {
+                        if (!deterministic &&
+                            reinterpret_cast<std::uintptr_t>(dst_ptr) % std::atomic_ref<T>::required_alignment == 0) {
+                            parallel_for(cols, cols, [&](index_t begin, index_t end) {
+                                for (index_t k = begin; k < end; ++k)
+                                    std::atomic_ref<T>(dst_ptr[idx[k]*dim_stride])
+                                        .fetch_add(src_ptr[k*src_stride[0]], std::memory_order_relaxed);
+                            });
+                            return;
+                        }
+                    }
+                    run(0, 1, 0, cols);
+                } else if (dim == 0) {
+                    parallel_for(cols, index.d_size(), [&](index_t begin, index_t end) {
+                        run(0, rows, begin, end);
+                    });
+                } else {
+                    index_t block = rows / shape[0];
+                    parallel_for(shape[0], index.d_size(), [&](index_t begin, index_t end) {
+                        run(begin*block, end*block, 0, cols);
+                    });
+                }
+            });
+            return self;
+        }
+    }
+
+    Tensor index_select(const Tensor& input, index_t dim, const Tensor& indices) {
+        CHECK_IN_RANGE(dim, 0, input.n_dim(),
+            "Dimension out of range (expected to be in range of [0, %zu), but got %zu)", input.n_dim(), dim);
+        CHECK_EQUAL(indices.n_dim(), 1, "index_select() expects a 1D index tensor, but got %zuD", indices.n_dim());
+        Shape shape(input.size());
+        shape[dim] = indices.d_size();
+        if (!input.ptr()->is_contiguous()) {
+            // strided input: gather with the indices broadcast over the other dimensions
+            Shape index_shape(shape);
+            for (index_t d = 0; d < shape.n_dim(); ++d)
+                if (d != dim) index_shape[d] = 1;
+            return gather(input, dim, indices.view(index_shape).expand(shape));
+        }
+
+        // each (outer index, selected index) pair is one contiguous row of the
+        // inner dimensions
+        std::vector<index_t> idx = read_index(indices, input.size(dim));
+        Tensor res = Tensor::empty(shape, input.dtype());
+        index_t len = idx.size(), size = input.size(dim);
+        index_t outer = shape.sub_size(0, dim), inner = shape.sub_size(dim+1);
+        index_t row = inner * dtype_size(input.dtype());
+        const char* src = static_cast<const char*>(std::as_const(*input.ptr()).storage().raw());
+        char* dst = static_cast<char*>(res.ptr()->storage().raw());
+        parallel_for(outer*len, res.d_size(), [&](index_t begin, index_t end) {
+            if (inner == 1) { // single elements: a typed copy beats a memcpy call
+                dispatch(input.dtype(), [&]<typename T>() {
+                    for (index_t i = begin; i < end; ++i)
+                        reinterpret_cast<T*>(dst)[i] = reinterpret_cast<const T*>(src)[i/len*size + idx[i%len]];
+                });
+                return;
+            }
+            for (index_t i = begin; i < end; ++i)
+                std::memcpy(dst + i*row, src + (i/len*size + idx[i%len])*row, row);
+        });
+        return res;
+    }
+
+    Tensor gather(const Tensor& input, index_t dim, const Tensor& index) {
+        check_index_shape("gather", input, dim, index);
+        std::vector<index_t> idx = read_index(index, input.size(dim));
+        Tensor res = Tensor::empty(index.size(), input.dtype());
+        if (index.d_size() == 0) return res;
+
+        const Shape& shape = index.size();
+        index_t n = shape.n_dim(), cols = shape[n-1], rows = index.d_size() / cols;
+        const IndexArray& stride = input.ptr()->stride();
+        index_t col_stride = dim == n-1 ? 0 : stride[n-1], dim_stride = stride[dim];
+        dispatch(input.dtype(), [&]<typename T>() {
+            const T* src = std::as_const(*input.ptr()).storage().data<T>();
+            T* dst = res.ptr()->storage().data<T>();
+            parallel_for(rows, index.d_size(), [&](index_t begin, index_t end) {
+                for (index_t r = begin; r < end; ++r) {
+                    const T* row = src + row_offset(shape, stride, r, dim);
+                    const index_t* row_idx = &idx[r*cols];
+                    for (index_t k = 0; k < cols; ++k)
+                        dst[r*cols + k] = row[k*col_stride + row_idx[k]*dim_stride];
+                }
+            });
+        });
+        return res;
+    }
+
+    Tensor& scatter(Tensor& self, index_t dim, const Tensor& index, const Tensor& src) {
+        return scatter_impl<false>(self, dim, index, src, true);
+    }
+
+    Tensor& scatter_add(Tensor& self, index_t dim, const Tensor& index, const Tensor& src, bool deterministic) {
+        return scatter_impl<true>(self, dim, index, src, deterministic);
+    }
+} // st
@@ -0,0 +1,205 @@
+#include "loader.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string_view>
+
+namespace st {
+    namespace {
+        constexpr index_t CHUNK_SIZE = 1 << 20;
+
+        // An error met on the worker thread. next() raises it as an err::Error
+        // on the caller's thread, since Error formats into one static buffer.
+        struct LoadError {
+            std::string msg;
+        };
+
+        template<typename... Args>
+        [[noreturn]] void load_error(const char* format, Args... args) {
+            char msg[256];
+            std::snprintf(msg, sizeof(msg), format, args...);
+            throw LoadError{msg};
+        }
+
+        // hands out the lines of a file, reading it a chunk at a time
+        class LineReader {
+        public:
+            explicit LineReader(const std::string& path) : _path(path), _in(path, std::ios::binary), _pos(0) {
+                CHECK_TRUE(_in, "Cannot open %s", path.c_str());
+            }
+
+            // the line stays valid until the next call
+            bool next(std::string_view& line) {
+                while (true) {
+                    auto end = _buf.find('\n', _pos);
+                    if (end != std::string::npos || (!_in && _pos < _buf.size())) {
+                        if (end == std::string::npos) end = _buf.size();
+                        line = std::string_view(_buf).substr(_pos, end-_pos);
+                        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                        _pos = end+1;
+                        ++_line_no;
+                        return true;
+                    }
+                    if (!_in) return false;
+                    _buf.erase(0, _pos);
+                    _pos = 0;
+                    index_t size = _buf.size();
+                    _buf.resize(size + CHUNK_SIZE);
+                    _in.read(_buf.data() + size, CHUNK_SIZE);
+                    _buf.resize(size + _in.gcount());
+                }
+            }
+            // the line handed out last is handed out again by the next call
+            void unread(std::string_view line) {
+                _pos = line.data() - _buf.data();
+                --_line_no;
+            }
+            [[nodiscard]] const std::string& path() const { return _path; }
+            // 1-based number of the line handed out last
+            [[nodiscard]] index_t line_no() const { return _line_no; }
+
+        private:
+            std::string _path;
+            std::ifstream _in;
+            std::string _buf;
+            index_t _pos;
+            index_t _line_no = 0;
+        };
+
+        // parses the delimited numbers of line into dst, returning how many there
+        // were. Errors quote only the start of the line.
+        template<typename T>
+        index_t parse_row(std::string_view line, char delimiter, T* dst, index_t n_fields, const LineReader& reader) {
+            const char* ptr = line.data();
+            const char* end = line.data() + line.size();
+            index_t n = 0;
+            while (true) {
+                while (ptr < end && *ptr == ' ') ++ptr;
+                data_t value;
+                auto [next, ec] = std::from_chars(ptr, end, value);
+                if (ec != std::errc())
+                    load_error("Cannot parse a number from \"%.*s\" on line %zu of %.100s",
+                        (int)std::min<index_t>(line.size(), 40), line.data(), reader.line_no(), reader.path().c_str());
+                if (n < n_fields) dst[n] = static_cast<T>(value);
+                ++n;
+                ptr = next;
+                while (ptr < end && *ptr == ' ') ++ptr;
+                if (ptr == end) break;
+                if (*ptr != delimiter)
+                    load_error("Unexpected '%c' on line %zu of %.100s", *ptr, reader.line_no(), reader.path().c_str());
+                ++ptr;
+            }
+            return n;
+        }
+    }
+
+    BatchLoader::BatchLoader(const std::string& path, const CsvFormat& format, index_t batch_size, index_t prefetch) :
+        _n_fields(0), _batch_size(batch_size), _prefetch(prefetch) {
+        CHECK_TRUE(batch_size > 0 && prefetch > 0, "Batch size and prefetch depth must be positive");
+        auto reader = std::make_shared<LineReader>(path);
+        std::string_view line;
+        for (index_t i = 0; i < format.skip_rows && reader->next(line); ++i) {}
+        // the first row fixes the number of fields
+        bool found;
+        while ((found = reader->next(line)) && line.empty()) {}
+        if (found) {
+            _n_fields = std::count(line.begin(), line.end(), format.delimiter) + 1;
+            reader->unread(line);
+        }
+        char delimiter = format.delimiter;
+        index_t n_fields = _n_fields;
+        start([reader, delimiter, n_fields](Tensor& batch) {
+            return dispatch(batch.dtype(), [&]<typename T>() {
+                T* dst = batch.ptr()->storage().data<T>();
+                index_t rows = 0;
+                std::string_view line;
+                while (rows < batch.size(0) && reader->next(line)) {
+                    if (line.empty()) continue;
+                    index_t n = parse_row(line, delimiter, dst + rows*n_fields, n_fields, *reader);
+                    if (n != n_fields)
+                        load_error("Expected %zu fields, but got %zu on line %zu of %.100s",
+                            n_fields, n, reader->line_no(), reader->path().c_str());
+                    ++rows;
+                }
+                return rows;
+            });
+        }, format.dtype);
+    }
+
+    BatchLoader::BatchLoader(const std::string& path, const BinaryFormat& format, index_t batch_size, index_t prefetch) :
+        _n_fields(format.n_fields), _batch_size(batch_size), _prefetch(prefetch) {
+        CHECK_TRUE(batch_size > 0 && prefetch > 0, "Batch size and prefetch depth must be positive");
+        CHECK_TRUE(format.n_fields > 0, "Binary records need at least one field");
+        auto in = std::make_shared<std::ifstream>(path, std::ios::binary);
+        CHECK_TRUE(*in, "Cannot open %s", path.c_str());
+        index_t record = format.n_fields * dtype_size(format.dtype);
+        start([in, record, path](Tensor& batch) {
+            // records are read straight into the batch, no parsing involved
+            char* dst = static_cast<char*>(batch.ptr()->storage().raw());
+            in->read(dst, (std::streamsize)(batch.size(0) * record));
+            index_t n_bytes = in->gcount();
+            if (n_bytes % record != 0) load_error("%.200s ends with a partial record", path.c_str());
+            return n_bytes / record;
+        }, format.dtype);
+    }
+
+    BatchLoader::~BatchLoader() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _not_full.notify_all();
+        if (_worker.joinable()) _worker.join();
+    }
+
+    void BatchLoader::start(std::function<index_t(Tensor&)> fill, DType dtype) {
+        if (_n_fields == 0) { // nothing to read
+            _done = true;
+            return;
+        }
+        _worker = std::thread([this, fill = std::move(fill), dtype] {
+            try {
+                while (true) {
+                    Tensor batch = Tensor::empty({_batch_size, _n_fields}, dtype);
+                    index_t rows = fill(batch);
+                    if (rows == 0) break;
+                    if (rows < _batch_size) batch = batch.slice(0, rows, 0);
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _not_full.wait(lock, [this] { return _stop || _queue.size() < _prefetch; });
+                    if (_stop) break;
+                    _queue.push_back(std::move(batch));
+                    _not_empty.notify_one();
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            _done = true;
+            _not_empty.notify_all();
+        });
+    }
+
+    std::optional<Tensor> BatchLoader::next() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_empty.wait(lock, [this] { return _done || !_queue.empty(); });
+        if (_queue.empty()) {
+            if (_error) {
+                try {
+                    std::rethrow_exception(std::exchange(_error, nullptr));
+                } catch (const LoadError& error) {
+                    THROW_ERROR("%s", error.msg.c_str());
+                }
+            }
+            return std::nullopt;
+        }
+        Tensor batch = std::move(_queue.front());
+        _queue.pop_front();
+        _not_full.notify_one();
+        return batch;
+    }
+} // st
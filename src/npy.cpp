@@ -0,0 +1,362 @@
+#include "npy.h"
+#include "exception.h"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace st {
+    namespace {
+        constexpr char NPY_MAGIC[6] = {'\x93', 'N', 'U', 'M', 'P', 'Y'};
+
+        struct NpyHeader {
+            DType dtype;
+            bool fortran_order;
+            std::vector<index_t> shape;
+            index_t size; // header bytes before the payload
+        };
+
+        template<typename T>
+        T get(const char* ptr) {
+            T value;
+            std::memcpy(&value, ptr, sizeof(T));
+            return value;
+        }
+
+        template<typename T>
+        void put(std::string& out, T value) {
+            out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        const char* npy_descr(DType dtype) {
+            switch (dtype) {
+                case DType::Int8: return "|i1";
+                case DType::UInt8: return "|u1";
+                case DType::Int32: return "<i4";
+                case DType::Int64: return "<i8";
+                case DType::Float16: return "<f2";
+                case DType::Float32: return "<f4";
+                case DType::Float64: return "<f8";
+                default: THROW_ERROR("%s has no NumPy equivalent", dtype_name(dtype));
+            }
+        }
+
+        DType npy_dtype(const std::string& descr) {
+            for (DType dtype : {DType::Int8, DType::UInt8, DType::Int32, DType::Int64,
+                                DType::Float16, DType::Float32, DType::Float64}) {
+                std::string name = npy_descr(dtype);
+                // '<' little endian, '|' not applicable, '=' native
+                if (descr.size() == name.size() && descr.substr(1) == name.substr(1)
+                    && (descr[0] == '<' || descr[0] == '|' || descr[0] == '='))
+                    return dtype;
+            }
+            THROW_ERROR("Unsupported .npy dtype '%s'", descr.c_str());
+        }
+
+        // the value following 'key': in the header dict
+        std::string npy_field(const std::string& header, const char* key) {
+            std::string quoted = std::string("'") + key + "'";
+            auto pos = header.find(quoted);
+            CHECK_TRUE(pos != std::string::npos, "Missing '%s' in .npy header", key);
+            pos = header.find(':', pos + quoted.size());
+            CHECK_TRUE(pos != std::string::npos, "Malformed .npy header");
+            pos = header.find_first_not_of(' ', pos+1);
+            CHECK_TRUE(pos != std::string::npos, "Malformed .npy header");
+            auto end = header[pos] == '(' ? header.find(')', pos) + 1
+                     : header[pos] == '\'' ? header.find('\'', pos+1) + 1
+                     : header.find_first_of(",}", pos);
+            CHECK_TRUE(end != std::string::npos && end != 0, "Malformed .npy header");
+            return header.substr(pos, end-pos);
+        }
+
+        NpyHeader read_npy_header(std::istream& in, const std::string& path) {
+            char prefix[12];
+            in.read(prefix, 10);
+            CHECK_TRUE(in && std::memcmp(prefix, NPY_MAGIC, sizeof(NPY_MAGIC)) == 0,
+                "%s is not a .npy file", path.c_str());
+            int major = (unsigned char)prefix[6];
+            index_t prefix_size = 10, header_len = get<uint16_t>(prefix+8);
+            if (major >= 2) {
+                in.read(prefix+10, 2);
+                prefix_size = 12;
+                header_len = get<uint32_t>(prefix+8);
+            }
+            std::string header(header_len, '\0');
+            in.read(header.data(), (std::streamsize)header_len);
+            CHECK_TRUE(in, "Unexpected end of .npy header in %s", path.c_str());
+
+            NpyHeader res{};
+            std::string descr = npy_field(header, "descr");
+            res.dtype = npy_dtype(descr.substr(1, descr.size()-2));
+            res.fortran_order = npy_field(header, "fortran_order") == "True";
+            std::string shape = npy_field(header, "shape");
+            for (index_t pos = 1; pos < shape.size(); ) {
+                pos = shape.find_first_of("0123456789", pos);
+                if (pos == std::string::npos) break;
+                index_t end = shape.find_first_not_of("0123456789", pos);
+                res.shape.push_back(std::stoull(shape.substr(pos, end-pos)));
+                pos = end;
+            }
+            if (res.shape.empty()) res.shape.push_back(1); // a 0-d array becomes one element
+            res.size = prefix_size + header_len;
+            return res;
+        }
+
+        // size elements at offset into the file, read into memory of our own
+        Storage read_payload(const std::string& path, DType dtype, index_t offset, index_t size) {
+            Storage storage(size, dtype);
+            std::ifstream in(path, std::ios::binary);
+            in.seekg((std::streamoff)offset);
+            in.read(static_cast<char*>(storage.raw()), (std::streamsize)(size * dtype_size(dtype)));
+            CHECK_TRUE(in, "Unexpected end of %s", path.c_str());
+            return Storage(std::move(storage));
+        }
+
+        // payload maps from offset into the file, unless the elements would be
+        // misaligned there, as in zip archives written by other tools
+        Tensor map_npy(const std::string& path, const NpyHeader& header, index_t offset, MapMode mode) {
+            Shape shape(IndexArray(header.shape.data(), header.shape.size()));
+            CHECK_TRUE(shape.d_size() > 0, "Empty arrays are not supported (%s)", path.c_str());
+            Storage storage = offset % dtype_size(header.dtype) == 0
+                ? Storage::map_file(path, header.dtype, mode, offset, shape.d_size())
+                : read_payload(path, header.dtype, offset, shape.d_size());
+            if (!header.fortran_order) return Tensor(storage, shape);
+            IndexArray stride(shape.n_dim());
+            for (index_t i = 0; i < shape.n_dim(); ++i)
+                stride[i] = shape.sub_size(0, i);
+            return Tensor(storage, shape, stride);
+        }
+
+        // header padded so that the payload starts on a 64-byte boundary
+        std::string npy_header(const Tensor& tensor) {
+            std::string dict = std::string("{'descr': '") + npy_descr(tensor.dtype())
+                             + "', 'fortran_order': False, 'shape': (";
+            for (index_t i = 0; i < tensor.n_dim(); ++i)
+                dict += (i ? ", " : "") + std::to_string(tensor.size(i));
+            dict += tensor.n_dim() == 1 ? ",), }" : "), }";
+            bool v1 = dict.size() + 1 + 10 <= 65535;
+            index_t prefix_size = v1 ? 10 : 12;
+            dict.append((64 - (prefix_size + dict.size() + 1) % 64) % 64, ' ');
+            dict += '\n';
+            std::string res(NPY_MAGIC, sizeof(NPY_MAGIC));
+            res += v1 ? '\x01' : '\x02';
+            res += '\x00';
+            if (v1) put<uint16_t>(res, dict.size());
+            else put<uint32_t>(res, dict.size());
+            return res + dict;
+        }
+
+        const char* bytes(const Tensor& tensor) {
+            return static_cast<const char*>(std::as_const(*tensor.ptr()).storage().raw());
+        }
+
+        uint32_t crc32(uint32_t crc, const char* data, index_t n) {
+            static const auto table = [] {
+                std::array<uint32_t, 256> res{};
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; ++k)
+                        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    res[i] = c;
+                }
+                return res;
+            }();
+            crc = ~crc;
+            for (index_t i = 0; i < n; ++i)
+                crc = table[(crc ^ (unsigned char)data[i]) & 0xff] ^ (crc >> 8);
+            return ~crc;
+        }
+
+        constexpr uint32_t ZIP_LOCAL = 0x04034b50, ZIP_CENTRAL = 0x02014b50, ZIP_END = 0x06054b50,
+                           ZIP64_END = 0x06064b50, ZIP64_LOCATOR = 0x07064b50;
+        constexpr uint32_t ZIP_MAX32 = 0xffffffffu;
+        // extra field id for padding, the one zipalign uses
+        constexpr uint16_t ZIP_ALIGN = 0xd935;
+    }
+
+    Tensor load_npy(const std::string& path, MapMode mode) {
+        std::ifstream in(path, std::ios::binary);
+        CHECK_TRUE(in, "Cannot open %s", path.c_str());
+        NpyHeader header = read_npy_header(in, path);
+        return map_npy(path, header, header.size, mode);
+    }
+
+    void save_npy(const std::string& path, const Tensor& tensor) {
+        std::string header = npy_header(tensor);
+        Tensor data = tensor.contiguous();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        CHECK_TRUE(out, "Cannot open %s for writing", path.c_str());
+        out.write(header.data(), (std::streamsize)header.size());
+        out.write(bytes(data), (std::streamsize)(data.d_size() * dtype_size(data.dtype())));
+        CHECK_TRUE(out, "Failed to write %s", path.c_str());
+    }
+
+    std::map<std::string, Tensor> load_npz(const std::string& path, MapMode mode) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        CHECK_TRUE(in, "Cannot open %s", path.c_str());
+        index_t file_size = in.tellg();
+
+        // the end of central directory record sits in the last 64 KiB + 22 bytes
+        index_t tail_size = std::min<index_t>(file_size, 65535 + 22);
+        std::vector<char> tail(tail_size);
+        in.seekg((std::streamoff)(file_size - tail_size));
+        in.read(tail.data(), (std::streamsize)tail_size);
+        index_t end = tail_size < 22 ? std::string::npos : tail_size - 22;
+        while (end != std::string::npos && get<uint32_t>(&tail[end]) != ZIP_END)
+            end = end == 0 ? std::string::npos : end - 1;
+        CHECK_TRUE(in && end != std::string::npos, "%s is not a zip archive", path.c_str());
+        index_t entries = get<uint16_t>(&tail[end+10]);
+        index_t cd_size = get<uint32_t>(&tail[end+12]);
+        index_t cd_offset = get<uint32_t>(&tail[end+16]);
+        if (entries == 0xffff || cd_size == ZIP_MAX32 || cd_offset == ZIP_MAX32) {
+            CHECK_TRUE(end >= 20 && get<uint32_t>(&tail[end-20]) == ZIP64_LOCATOR,
+                "Missing zip64 locator in %s", path.c_str());
+            char record[56];
+            in.seekg((std::streamoff)get<uint64_t>(&tail[end-12]));
+            in.read(record, sizeof(record));
+            CHECK_TRUE(in && get<uint32_t>(record) == ZIP64_END, "Malformed zip64 record in %s", path.c_str());
+            entries = get<uint64_t>(record+32);
+            cd_size = get<uint64_t>(record+40);
+            cd_offset = get<uint64_t>(record+48);
+        }
+
+        std::vector<char> cd(cd_size);
+        in.seekg((std::streamoff)cd_offset);
+        in.read(cd.data(), (std::streamsize)cd_size);
+        CHECK_TRUE(in, "Unexpected end of %s", path.c_str());
+        std::map<std::string, Tensor> res;
+        for (index_t pos = 0, i = 0; i < entries; ++i) {
+            CHECK_TRUE(pos + 46 <= cd_size && get<uint32_t>(&cd[pos]) == ZIP_CENTRAL,
+                "Malformed central directory in %s", path.c_str());
+            uint16_t method = get<uint16_t>(&cd[pos+10]);
+            index_t name_len = get<uint16_t>(&cd[pos+28]), extra_len = get<uint16_t>(&cd[pos+30]);
+            index_t comment_len = get<uint16_t>(&cd[pos+32]);
+            index_t local = get<uint32_t>(&cd[pos+42]);
+            std::string name(&cd[pos+46], name_len);
+            // zip64 extra field: the 64-bit values of whichever fields are saturated
+            for (index_t e = pos+46+name_len; e + 4 <= pos+46+name_len+extra_len; ) {
+                uint16_t id = get<uint16_t>(&cd[e]), len = get<uint16_t>(&cd[e+2]);
+                if (id == 0x0001) {
+                    const char* field = &cd[e+4];
+                    if (get<uint32_t>(&cd[pos+24]) == ZIP_MAX32) field += 8; // uncompressed size
+                    if (get<uint32_t>(&cd[pos+20]) == ZIP_MAX32) field += 8; // compressed size
+                    if (local == ZIP_MAX32) local = get<uint64_t>(field);
+                }
+                e += 4 + len;
+            }
+            pos += 46 + name_len + extra_len + comment_len;
+            CHECK_EQUAL(method, 0, "%s in %s is compressed, only stored .npz members can be mapped",
+                name.c_str(), path.c_str());
+
+            char header[30];
+            in.seekg((std::streamoff)local);
+            in.read(header, sizeof(header));
+            CHECK_TRUE(in && get<uint32_t>(header) == ZIP_LOCAL, "Malformed local header in %s", path.c_str());
+            index_t data = local + 30 + get<uint16_t>(header+26) + get<uint16_t>(header+28);
+            in.seekg((std::streamoff)data);
+            NpyHeader npy = read_npy_header(in, path);
+            if (name.size() >= 4 && name.compare(name.size()-4, 4, ".npy") == 0)
+                name.resize(name.size()-4);
+            res.emplace(name, map_npy(path, npy, data + npy.size, mode));
+        }
+        return res;
+    }
+
+    void save_npz(const std::string& path, const std::map<std::string, Tensor>& tensors) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        CHECK_TRUE(out, "Cannot open %s for writing", path.c_str());
+        std::string cd;
+        index_t offset = 0;
+        for (auto& [key, tensor] : tensors) {
+            std::string name = key + ".npy";
+            std::string header = npy_header(tensor);
+            Tensor data = tensor.contiguous();
+            index_t n_bytes = data.d_size() * dtype_size(data.dtype());
+            index_t size = header.size() + n_bytes;
+            uint32_t crc = crc32(crc32(0, header.data(), header.size()), bytes(data), n_bytes);
+            bool zip64 = size >= ZIP_MAX32 || offset >= ZIP_MAX32;
+
+            std::string local;
+            put<uint32_t>(local, ZIP_LOCAL);
+            put<uint16_t>(local, zip64 ? 45 : 20); // version needed
+            put<uint16_t>(local, 0);               // flags
+            put<uint16_t>(local, 0);               // stored
+            put<uint16_t>(local, 0);               // time
+            put<uint16_t>(local, 0x21);            // date, 1980-01-01
+            put<uint32_t>(local, crc);
+            put<uint32_t>(local, zip64 ? ZIP_MAX32 : size);
+            put<uint32_t>(local, zip64 ? ZIP_MAX32 : size);
+            put<uint16_t>(local, name.size());
+            // a padding field brings the payload, which follows a header of a
+            // multiple of 64 bytes, onto a 64-byte boundary for mapping
+            index_t extra = zip64 ? 20 : 0;
+            index_t pad = (64 - (offset + local.size() + 2 + name.size() + extra + 4) % 64) % 64;
+            put<uint16_t>(local, extra + 4 + pad);
+            local += name;
+            if (zip64) {
+                put<uint16_t>(local, 0x0001);
+                put<uint16_t>(local, 16);
+                put<uint64_t>(local, size);
+                put<uint64_t>(local, size);
+            }
+            put<uint16_t>(local, ZIP_ALIGN);
+            put<uint16_t>(local, pad);
+            local.append(pad, '\0');
+            out.write(local.data(), (std::streamsize)local.size());
+            out.write(header.data(), (std::streamsize)header.size());
+            out.write(bytes(data), (std::streamsize)n_bytes);
+
+            put<uint32_t>(cd, ZIP_CENTRAL);
+            put<uint16_t>(cd, zip64 ? 45 : 20);    // version made by
+            cd.append(local, 4, 24);               // version needed up to the name length
+            put<uint16_t>(cd, zip64 ? 28 : 0);     // extra length
+            put<uint16_t>(cd, 0);                  // comment length
+            put<uint16_t>(cd, 0);                  // disk
+            put<uint16_t>(cd, 0);                  // internal attributes
+            put<uint32_t>(cd, 0);                  // external attributes
+            put<uint32_t>(cd, zip64 ? ZIP_MAX32 : offset);
+            cd += name;
+            if (zip64) {
+                put<uint16_t>(cd, 0x0001);
+                put<uint16_t>(cd, 24);
+                put<uint64_t>(cd, size);
+                put<uint64_t>(cd, size);
+                put<uint64_t>(cd, offset);
+            }
+            offset += local.size() + size;
+        }
+        out.write(cd.data(), (std::streamsize)cd.size());
+
+        std::string end;
+        bool zip64 = offset >= ZIP_MAX32 || cd.size() >= ZIP_MAX32 || tensors.size() >= 0xffff;
+        if (zip64) {
+            put<uint32_t>(end, ZIP64_END);
+            put<uint64_t>(end, 44);
+            put<uint16_t>(end, 45);
+            put<uint16_t>(end, 45);
+            put<uint32_t>(end, 0);
+            put<uint32_t>(end, 0);
+            put<uint64_t>(end, tensors.size());
+            put<uint64_t>(end, tensors.size());
+            put<uint64_t>(end, cd.size());
+            put<uint64_t>(end, offset);
+            put<uint32_t>(end, ZIP64_LOCATOR);
+            put<uint32_t>(end, 0);
+            put<uint64_t>(end, offset + cd.size());
+            put<uint32_t>(end, 1);
+        }
+        put<uint32_t>(end, ZIP_END);
+        put<uint16_t>(end, 0);
+        put<uint16_t>(end, 0);
+        put<uint16_t>(end, zip64 ? 0xffff : tensors.size());
+        put<uint16_t>(end, zip64 ? 0xffff : tensors.size());
+        put<uint32_t>(end, zip64 ? ZIP_MAX32 : cd.size());
+        put<uint32_t>(end, zip64 ? ZIP_MAX32 : offset);
+        put<uint16_t>(end, 0);
+        out.write(end.data(), (std::streamsize)end.size());
+        CHECK_TRUE(out, "Failed to write %s", path.c_str());
+    }
+} // st
@@ -0,0 +1,188 @@
+#include "quantize.h"
+#include "cpu.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#ifdef ST_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace st {
+    namespace {
+#ifdef ST_X86_DISPATCH
+        // the dot product of the leading multiple of 64 elements
+        __attribute__((target("avx512f,avx512bw,avx512vnni")))
+        int32_t dot_u8s8_vnni(const uint8_t* a, const int8_t* b, index_t n, index_t& k) {
+            __m512i acc = _mm512_setzero_si512();
+            for (; k + 64 <= n; k += 64)
+                acc = _mm512_dpbusd_epi32(acc, _mm512_loadu_si512(a+k), _mm512_loadu_si512(b+k));
+            return _mm512_reduce_add_epi32(acc);
+        }
+
+        // the dot product of the leading multiple of 16 elements
+        __attribute__((target("avx2")))
+        int32_t dot_u8s8_avx2(const uint8_t* a, const int8_t* b, index_t n, index_t& k) {
+            // maddubs would saturate its 16-bit pair sums for full range
+            // operands, so widen to 16 bits and use madd instead
+            __m256i acc = _mm256_setzero_si256();
+            for (; k + 16 <= n; k += 16) {
+                __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a+k)));
+                __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b+k)));
+                acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+            }
+            __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            sum = _mm_hadd_epi32(sum, sum);
+            sum = _mm_hadd_epi32(sum, sum);
+            return _mm_cvtsi128_si32(sum);
+        }
+#endif
+
+        // |a[k]*b[k]| <= 255*128, so int32 sums of up to this many are exact
+        constexpr index_t kDotBlock = 65792;
+
+        // sum of a[k]*b[k] for n <= kDotBlock
+        int32_t dot_u8s8_block(const uint8_t* a, const int8_t* b, index_t n) {
+            index_t k = 0;
+            int32_t res = 0;
+#ifdef ST_X86_DISPATCH
+            cpu::Isa isa = cpu::isa();
+            if (isa >= cpu::Isa::AVX512VNNI) res = dot_u8s8_vnni(a, b, n, k);
+            else if (isa >= cpu::Isa::AVX2) res = dot_u8s8_avx2(a, b, n, k);
+#endif
+            for (; k < n; ++k)
+                res += (int32_t)a[k] * (int32_t)b[k];
+            return res;
+        }
+
+        // sum of a[k]*b[k], added up in int64 over blocks of kDotBlock
+        int64_t dot_u8s8(const uint8_t* a, const int8_t* b, index_t n) {
+            int64_t res = 0;
+            for (index_t k = 0; k < n; k += kDotBlock)
+                res += dot_u8s8_block(a+k, b+k, std::min(kDotBlock, n-k));
+            return res;
+        }
+
+        int32_t qvalue(const Tensor& tensor, index_t i, index_t j) {
+            const TensorImpl& impl = *tensor.ptr();
+            index_t idx = i*impl.stride()[0] + j*impl.stride()[1];
+            if (impl.dtype() == DType::Int8) return impl.storage().data<int8_t>()[idx];
+            return impl.storage().data<uint8_t>()[idx];
+        }
+
+        template<typename T>
+        void quantize_into(const data_t* src, T* dst, index_t n, index_t inner, index_t channels,
+                           const std::vector<data_t>& scale, const std::vector<int32_t>& zero_point) {
+            for (index_t i = 0; i < n; ++i) {
+                index_t c = i / inner % channels;
+                data_t q = std::nearbyint(src[i] / scale[c]) + zero_point[c];
+                dst[i] = (T)std::clamp<data_t>(q, std::numeric_limits<T>::min(), std::numeric_limits<T>::max());
+            }
+        }
+
+        QTensor quantize_impl(const Tensor& tensor, const std::vector<data_t>& scale,
+                              const std::vector<int32_t>& zero_point, int axis, DType dtype) {
+            CHECK_TRUE(dtype == DType::Int8 || dtype == DType::UInt8,
+                "Quantized tensors hold int8 or uint8, but got %s", dtype_name(dtype));
+            int32_t q_min = dtype == DType::Int8 ? -128 : 0;
+            for (index_t c = 0; c < scale.size(); ++c) {
+                CHECK_TRUE(scale[c] > 0, "Quantization scale must be positive, but got %f", scale[c]);
+                CHECK_IN_RANGE(zero_point[c], q_min, q_min+256,
+                    "Zero point %d is out of range for %s", zero_point[c], dtype_name(dtype));
+            }
+            Tensor src = tensor.to(DType::Float64);
+            Tensor res = Tensor::empty(tensor.size(), dtype);
+            index_t inner = axis < 0 ? 1 : tensor.size().sub_size(axis+1);
+            const data_t* src_ptr = std::as_const(*src.ptr()).storage().data<data_t>();
+            if (dtype == DType::Int8)
+                quantize_into(src_ptr, res.ptr()->storage().data<int8_t>(), tensor.d_size(), inner,
+                              scale.size(), scale, zero_point);
+            else
+                quantize_into(src_ptr, res.ptr()->storage().data<uint8_t>(), tensor.d_size(), inner,
+                              scale.size(), scale, zero_point);
+            return QTensor(res, scale, zero_point, axis);
+        }
+    }
+
+    QTensor::QTensor(const Tensor& data, std::vector<data_t> scale, std::vector<int32_t> zero_point, int axis) :
+        _data(data), _scale(std::move(scale)), _zero_point(std::move(zero_point)), _axis(axis) {
+        CHECK_TRUE(dtype() == DType::Int8 || dtype() == DType::UInt8,
+            "Quantized tensors hold int8 or uint8, but got %s", dtype_name(dtype()));
+        CHECK_TRUE(axis < (int)n_dim(),
+            "Dimension out of range (expected to be in range of [0, %zu), but got %d)", n_dim(), axis);
+        index_t channels = axis < 0 ? 1 : size(axis);
+        CHECK_TRUE(_scale.size() == channels && _zero_point.size() == channels,
+            "Expected %zu scales and zero points, but got %zu and %zu",
+            channels, _scale.size(), _zero_point.size());
+    }
+
+    QTensor quantize(const Tensor& tensor, data_t scale, int32_t zero_point, DType dtype) {
+        return quantize_impl(tensor, {scale}, {zero_point}, -1, dtype);
+    }
+
+    QTensor quantize_per_channel(const Tensor& tensor, const std::vector<data_t>& scale,
+                                 const std::vector<int32_t>& zero_point, index_t axis, DType dtype) {
+        CHECK_IN_RANGE(axis, 0, tensor.n_dim(),
+            "Dimension out of range (expected to be in range of [0, %zu), but got %zu)", tensor.n_dim(), axis);
+        CHECK_TRUE(scale.size() == tensor.size(axis) && zero_point.size() == tensor.size(axis),
+            "Expected %zu scales and zero points, but got %zu and %zu",
+            tensor.size(axis), scale.size(), zero_point.size());
+        return quantize_impl(tensor, scale, zero_point, (int)axis, dtype);
+    }
+
+    Tensor dequantize(const QTensor& tensor, DType dtype) {
+        Tensor res = tensor.data().to(DType::Float64);
+        data_t* ptr = res.ptr()->storage().data<data_t>();
+        index_t inner = tensor.axis() < 0 ? 1 : tensor.size().sub_size(tensor.axis()+1);
+        index_t channels = tensor.axis() < 0 ? 1 : tensor.size(tensor.axis());
+        for (index_t i = 0; i < res.d_size(); ++i) {
+            index_t c = i / inner % channels;
+            ptr[i] = (ptr[i] - tensor.zero_point(c)) * tensor.scale(c);
+        }
+        return dtype == DType::Float64 ? res : res.to(dtype);
+    }
+
+    Tensor matmul(const QTensor& lhs, const QTensor& rhs, DType dtype) {
+        CHECK_TRUE(lhs.n_dim() == 2 && rhs.n_dim() == 2,
+            "Quantized matmul expects 2D operands, but got %zuD and %zuD", lhs.n_dim(), rhs.n_dim());
+        index_t M = lhs.size(0), K = lhs.size(1), N = rhs.size(1);
+        CHECK_EQUAL(K, rhs.size(0),
+            "mat1 and mat2 shapes cannot be multiplied (%zux%zu and %zux%zu)", M, K, rhs.size(0), N);
+        CHECK_TRUE(lhs.axis() <= 0, "The left operand must be quantized per tensor or per row");
+        CHECK_TRUE(rhs.axis() < 0 || rhs.axis() == 1, "The right operand must be quantized per tensor or per column");
+
+        // the kernel multiplies unsigned lhs by signed rhs, so int8 lhs and
+        // uint8 rhs values are moved by 128 together with their zero points
+        int32_t lhs_shift = lhs.dtype() == DType::Int8 ? 128 : 0;
+        int32_t rhs_shift = rhs.dtype() == DType::UInt8 ? -128 : 0;
+        std::vector<uint8_t> a(M*K);
+        std::vector<int8_t> b_t(N*K); // rhs transposed, so that both walk k contiguously
+        std::vector<int64_t> a_sum(M, 0), b_sum(N, 0);
+        for (index_t i = 0; i < M; ++i)
+            for (index_t k = 0; k < K; ++k) {
+                a[i*K+k] = (uint8_t)(qvalue(lhs.data(), i, k) + lhs_shift);
+                a_sum[i] += a[i*K+k];
+            }
+        for (index_t k = 0; k < K; ++k)
+            for (index_t j = 0; j < N; ++j) {
+                b_t[j*K+k] = (int8_t)(qvalue(rhs.data(), k, j) + rhs_shift);
+                b_sum[j] += b_t[j*K+k];
+            }
+
+        // sum (a - za)(b - zb) = sum ab - zb sum a - za sum b + K za zb
+        Tensor res = Tensor::empty({M, N}, dtype);
+        void* out = res.ptr()->storage().raw();
+        for (index_t i = 0; i < M; ++i) {
+            int64_t za = lhs.zero_point(i) + lhs_shift;
+            for (index_t j = 0; j < N; ++j) {
+                int64_t zb = rhs.zero_point(j) + rhs_shift;
+                int64_t acc = dot_u8s8(&a[i*K], &b_t[j*K], K) - zb*a_sum[i] - za*b_sum[j] + (int64_t)K*za*zb;
+                store(out, dtype, i*N+j, (data_t)acc * lhs.scale(i) * rhs.scale(j));
+            }
+        }
+        return res;
+    }
+} // st
@@ -0,0 +1,198 @@
+#include "safetensors.h"
+#include "exception.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace st {
+    namespace {
+        // just enough JSON for a safetensors header
+        class JsonReader {
+        public:
+            explicit JsonReader(const std::string& text) : _text(text), _pos(0) {}
+
+            bool consume(char c) {
+                skip_space();
+                if (_pos < _text.size() && _text[_pos] == c) {
+                    ++_pos;
+                    return true;
+                }
+                return false;
+            }
+            void expect(char c) {
+                CHECK_TRUE(consume(c), "Malformed safetensors header: expected '%c' at byte %zu", c, _pos);
+            }
+            // calls f() for each element of an array or value of an object, after
+            // reading the key into key
+            template<typename F>
+            void each(char open, char close, std::string* key, F&& f) {
+                expect(open);
+                if (consume(close)) return;
+                do {
+                    if (key) {
+                        *key = string();
+                        expect(':');
+                    }
+                    f();
+                } while (consume(','));
+                expect(close);
+            }
+            std::string string() {
+                expect('"');
+                std::string res;
+                while (_pos < _text.size() && _text[_pos] != '"') {
+                    char c = _text[_pos++];
+                    if (c == '\\' && _pos < _text.size()) {
+                        c = _text[_pos++];
+                        if (c == 'n') c = '\n';
+                        else if (c == 't') c = '\t';
+                        else if (c == 'u' && _pos + 4 <= _text.size()) { // code point as UTF-8, BMP only
+                            auto code = (uint32_t)std::stoul(_text.substr(_pos, 4), nullptr, 16);
+                            _pos += 4;
+                            if (code < 0x80) {
+                                res += (char)code;
+                            } else if (code < 0x800) {
+                                res += (char)(0xc0 | code >> 6);
+                                res += (char)(0x80 | (code & 0x3f));
+                            } else {
+                                res += (char)(0xe0 | code >> 12);
+                                res += (char)(0x80 | (code >> 6 & 0x3f));
+                                res += (char)(0x80 | (code & 0x3f));
+                            }
+                            continue;
+                        }
+                    }
+                    res += c;
+                }
+                expect('"');
+                return res;
+            }
+            index_t integer() {
+                skip_space();
+                index_t start = _pos;
+                while (_pos < _text.size() && _text[_pos] >= '0' && _text[_pos] <= '9') ++_pos;
+                CHECK_TRUE(_pos > start, "Malformed safetensors header: expected an integer at byte %zu", start);
+                return std::stoull(_text.substr(start, _pos-start));
+            }
+            void skip_value() {
+                skip_space();
+                CHECK_TRUE(_pos < _text.size(), "Unexpected end of safetensors header");
+                std::string key;
+                if (_text[_pos] == '{') each('{', '}', &key, [&] { skip_value(); });
+                else if (_text[_pos] == '[') each('[', ']', nullptr, [&] { skip_value(); });
+                else if (_text[_pos] == '"') string();
+                else while (_pos < _text.size() && !std::strchr(",}] \n\t\r", _text[_pos])) ++_pos;
+            }
+            [[nodiscard]] bool done() {
+                skip_space();
+                return _pos == _text.size();
+            }
+
+        private:
+            void skip_space() {
+                while (_pos < _text.size() && _text[_pos] && std::strchr(" \n\t\r", _text[_pos])) ++_pos;
+            }
+            const std::string& _text;
+            index_t _pos;
+        };
+
+        DType safetensors_dtype(const std::string& dtype) {
+            if (dtype == "F64") return DType::Float64;
+            if (dtype == "F32") return DType::Float32;
+            if (dtype == "F16") return DType::Float16;
+            if (dtype == "BF16") return DType::BFloat16;
+            if (dtype == "I64") return DType::Int64;
+            if (dtype == "I32") return DType::Int32;
+            if (dtype == "I8") return DType::Int8;
+            if (dtype == "U8") return DType::UInt8;
+            THROW_ERROR("Unsupported safetensors dtype %s", dtype.c_str());
+        }
+
+        // size elements at byte offset, read into owned storage
+        Storage read_payload(const std::string& path, DType dtype, index_t offset, index_t size) {
+            Storage storage(size, dtype);
+            std::ifstream in(path, std::ios::binary);
+            in.seekg((std::streamoff)offset);
+            in.read(static_cast<char*>(storage.raw()), (std::streamsize)(size * dtype_size(dtype)));
+            CHECK_TRUE(in, "Unexpected end of %s", path.c_str());
+            return Storage(std::move(storage));
+        }
+    }
+
+    SafeTensors::SafeTensors(const std::string& path, MapMode mode) : _path(path), _mode(mode) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        CHECK_TRUE(in, "Cannot open %s", path.c_str());
+        index_t file_size = in.tellg();
+        in.seekg(0);
+        uint64_t header_size = 0;
+        in.read(reinterpret_cast<char*>(&header_size), sizeof(header_size));
+        CHECK_TRUE(in && header_size <= file_size - sizeof(header_size),
+            "%s is not a safetensors file", path.c_str());
+        std::string header(header_size, '\0');
+        in.read(header.data(), (std::streamsize)header_size);
+        CHECK_TRUE(in, "Unexpected end of %s", path.c_str());
+        _data_offset = sizeof(header_size) + header_size;
+
+        JsonReader json(header);
+        std::string name, field;
+        json.each('{', '}', &name, [&] {
+            if (name == "__metadata__") {
+                json.each('{', '}', &field, [&] { _metadata[field] = json.string(); });
+                return;
+            }
+            Entry entry{"", {}, 0, 0, std::nullopt};
+            bool has_offsets = false;
+            json.each('{', '}', &field, [&] {
+                if (field == "dtype") {
+                    entry.dtype = json.string();
+                } else if (field == "shape") {
+                    json.each('[', ']', nullptr, [&] { entry.shape.push_back(json.integer()); });
+                } else if (field == "data_offsets") {
+                    json.expect('[');
+                    entry.begin = json.integer();
+                    json.expect(',');
+                    entry.end = json.integer();
+                    json.expect(']');
+                    has_offsets = true;
+                } else {
+                    json.skip_value();
+                }
+            });
+            CHECK_TRUE(has_offsets && entry.begin <= entry.end && _data_offset + entry.end <= file_size,
+                "Invalid data offsets for %s in %s", name.c_str(), path.c_str());
+            _entries.emplace(name, std::move(entry));
+        });
+        CHECK_TRUE(json.done(), "Trailing data after the safetensors header of %s", path.c_str());
+    }
+
+    std::vector<std::string> SafeTensors::names() const {
+        std::vector<std::string> res;
+        for (auto& [name, entry] : _entries)
+            res.push_back(name);
+        return res;
+    }
+
+    Tensor SafeTensors::get(const std::string& name) {
+        auto iter = _entries.find(name);
+        CHECK_TRUE(iter != _entries.end(), "No tensor named %s in %s", name.c_str(), _path.c_str());
+        Entry& entry = iter->second;
+        if (!entry.tensor) {
+            // each tensor gets its own mapping rather than a view of one mapping
+            // of the whole file, so that a clone copies out only that tensor.
+            // Elements that would be misaligned in the mapping are read instead.
+            DType dtype = safetensors_dtype(entry.dtype);
+            std::vector<index_t> dims = entry.shape.empty() ? std::vector<index_t>{1} : entry.shape;
+            Shape shape(IndexArray(dims.data(), dims.size()));
+            CHECK_EQUAL(shape.d_size() * dtype_size(dtype), entry.end - entry.begin,
+                "%s holds %zu bytes, but its shape and dtype need %zu",
+                name.c_str(), entry.end - entry.begin, shape.d_size() * dtype_size(dtype));
+            CHECK_TRUE(shape.d_size() > 0, "Empty tensors are not supported (%s)", name.c_str());
+            index_t offset = _data_offset + entry.begin;
+            Storage storage = offset % dtype_size(dtype) == 0
+                ? Storage::map_file(_path, dtype, _mode, offset, shape.d_size())
+                : read_payload(_path, dtype, offset, shape.d_size());
+            entry.tensor.emplace(storage, shape);
+        }
+        return *entry.tensor;
+    }
+} // st
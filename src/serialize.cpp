@@ -0,0 +1,114 @@
+#include "serialize.h"
+#include "exception.h"
+
+#include <fstream>
+#include <vector>
+
+namespace st {
+    namespace {
+        constexpr char MAGIC[8] = {'S', 'T', 'T', 'E', 'N', 'S', 'O', 'R'};
+        constexpr uint32_t VERSION = 1;
+        constexpr index_t ALIGNMENT = 64;
+
+        template<typename T>
+        void write(std::ostream& out, T value) {
+            out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template<typename T>
+        T read(std::istream& in, const std::string& path) {
+            T value;
+            in.read(reinterpret_cast<char*>(&value), sizeof(T));
+            CHECK_TRUE(in, "Unexpected end of tensor file %s", path.c_str());
+            return value;
+        }
+
+        index_t align(index_t offset) { return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+        index_t header_size(const std::map<std::string, Tensor>& tensors) {
+            index_t size = sizeof(MAGIC) + 2*sizeof(uint32_t);
+            for (auto& [name, tensor] : tensors)
+                size += sizeof(uint32_t) + name.size() + 2 + (2*tensor.n_dim() + 2)*sizeof(uint64_t);
+            return size;
+        }
+    }
+
+    void save(const std::string& path, const std::map<std::string, Tensor>& tensors) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        CHECK_TRUE(out, "Cannot open %s for writing", path.c_str());
+        out.write(MAGIC, sizeof(MAGIC));
+        write<uint32_t>(out, VERSION);
+        write<uint32_t>(out, tensors.size());
+
+        // payloads are written contiguous, with the strides TensorImpl gives
+        // a fresh tensor of that shape
+        index_t offset = align(header_size(tensors));
+        for (auto& [name, tensor] : tensors) {
+            write<uint32_t>(out, name.size());
+            out.write(name.data(), (std::streamsize)name.size());
+            write<uint8_t>(out, (uint8_t)tensor.dtype());
+            write<uint8_t>(out, tensor.n_dim());
+            for (index_t i = 0; i < tensor.n_dim(); ++i)
+                write<uint64_t>(out, tensor.size(i));
+            for (index_t i = 0; i < tensor.n_dim(); ++i)
+                write<uint64_t>(out, tensor.size(i) == 1 ? 0 : tensor.size().sub_size(i+1));
+            index_t n_bytes = tensor.d_size() * dtype_size(tensor.dtype());
+            write<uint64_t>(out, offset);
+            write<uint64_t>(out, n_bytes);
+            offset = align(offset + n_bytes);
+        }
+
+        for (auto& [name, tensor] : tensors) {
+            out.seekp((std::streamoff)align(out.tellp()));
+            Tensor data = tensor.contiguous();
+            out.write(static_cast<const char*>(std::as_const(*data.ptr()).storage().raw()),
+                      (std::streamsize)(data.d_size() * dtype_size(data.dtype())));
+        }
+        CHECK_TRUE(out, "Failed to write %s", path.c_str());
+    }
+
+    std::map<std::string, Tensor> load(const std::string& path, MapMode mode) {
+        std::ifstream in(path, std::ios::binary);
+        CHECK_TRUE(in, "Cannot open %s", path.c_str());
+        char magic[sizeof(MAGIC)];
+        in.read(magic, sizeof(magic));
+        CHECK_TRUE(in && std::equal(magic, magic+sizeof(magic), MAGIC), "%s is not a tensor file", path.c_str());
+        auto version = read<uint32_t>(in, path);
+        CHECK_EQUAL(version, VERSION, "Unsupported tensor file version %u in %s", version, path.c_str());
+
+        std::map<std::string, Tensor> res;
+        auto count = read<uint32_t>(in, path);
+        for (uint32_t t = 0; t < count; ++t) {
+            std::string name(read<uint32_t>(in, path), '\0');
+            in.read(name.data(), (std::streamsize)name.size());
+            auto dtype = read<uint8_t>(in, path);
+            CHECK_TRUE(dtype <= (uint8_t)DType::Float64, "Unknown dtype %u for %s in %s",
+                dtype, name.c_str(), path.c_str());
+            auto n_dim = read<uint8_t>(in, path);
+            CHECK_TRUE(n_dim > 0, "%s in %s has no dimensions", name.c_str(), path.c_str());
+            Shape shape(n_dim);
+            IndexArray stride(n_dim);
+            for (index_t i = 0; i < n_dim; ++i)
+                shape[i] = read<uint64_t>(in, path);
+            for (index_t i = 0; i < n_dim; ++i)
+                stride[i] = read<uint64_t>(in, path);
+            auto offset = read<uint64_t>(in, path);
+            auto n_bytes = read<uint64_t>(in, path);
+            index_t elem = dtype_size((DType)dtype);
+            CHECK_TRUE(n_bytes > 0 && n_bytes % elem == 0 && offset % elem == 0,
+                "Invalid payload of %zu bytes at byte %zu for %s in %s",
+                (index_t)n_bytes, (index_t)offset, name.c_str(), path.c_str());
+            index_t size = n_bytes / elem;
+            // every element the shape and strides reach has to lie in the payload
+            index_t last = 0;
+            for (index_t i = 0; i < n_dim; ++i) {
+                CHECK_TRUE(shape[i] > 0, "Empty tensors are not supported (%s in %s)", name.c_str(), path.c_str());
+                CHECK_TRUE(shape[i] == 1 || stride[i] <= (size - 1 - last) / (shape[i] - 1),
+                    "Shape and strides of %s reach past its %zu elements in %s", name.c_str(), size, path.c_str());
+                last += (shape[i] - 1) * stride[i];
+            }
+            res.emplace(name, Tensor(Storage::map_file(path, (DType)dtype, mode, offset, size), shape, stride));
+        }
+        return res;
+    }
+} // st
@@ -6,7 +6,7 @@ namespace st {
     Shape::Shape(std::initializer_list<index_t> dim) : _dim(dim) {}
     Shape::Shape(const Shape& other, index_t skip) : _dim(other.n_dim() - 1) {
         // skip the [skip] element
-        int idx = 0;
+        index_t idx = 0;
         while (idx < skip) {
             _dim[idx] = other._dim[idx];
             ++idx;
@@ -20,22 +20,22 @@ namespace st {
     Shape::Shape(Array<index_t>&& dim) : _dim(std::move(dim)) {}
 
     index_t Shape::d_size() const {
-        int size = 1;
-        for (int i = 0; i < _dim.size(); ++i)
+        index_t size = 1;
+        for (index_t i = 0; i < _dim.size(); ++i)
             size *= _dim[i];
         return size;
     }
 
     index_t Shape::sub_size(index_t start_dim, index_t end_dim) const {
-        int size = 1;
-        for (int i = start_dim; i < end_dim; ++i)
+        index_t size = 1;
+        for (index_t i = start_dim; i < end_dim; ++i)
             size *= _dim[i];
         return size;
     }
 
     index_t Shape::sub_size(index_t start_dim) const {
-        int size = 1;
-        for (int i = start_dim; i < _dim.size(); ++i)
+        index_t size = 1;
+        for (index_t i = start_dim; i < _dim.size(); ++i)
             size *= _dim[i];
         return size;
     }
@@ -1,21 +1,98 @@
 #include "storage.h"
+#include "exception.h"
 
+#include <cerrno>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <utility>
 
 namespace st {
-    Storage::Storage(index_t size) :
-            size_(size), b_ptr(Alloc::shared_allocate<Data>(size*sizeof(data_t)+sizeof(index_t))), f_ptr(b_ptr->data_) {}
+    Storage::Storage(index_t size, DType dtype) :
+            size_(size),
+            b_ptr(Alloc::shared_construct<Block>(Block{0, Alloc::shared_allocate<Data>(size*dtype_size(dtype))})),
+            offset_(0), dtype_(dtype) {}
     Storage::Storage(const Storage &other, index_t offset) :
-            size_(other.size_), b_ptr(other.b_ptr), f_ptr(other.f_ptr+offset) {}
-    Storage::Storage(index_t size, data_t value) : Storage(size) {
-        for (int i = 0; i < size; ++i)
-            *(f_ptr+i) = value;
+            size_(other.size_), b_ptr(other.b_ptr), offset_(offset), dtype_(other.dtype_) {}
+    Storage::Storage(index_t size, data_t value, DType dtype) : Storage(size, dtype) {
+        dispatch(dtype, [&]<typename T>() {
+            std::fill_n(data<T>(), size, from_data<T>(value));
+        });
     }
-    Storage::Storage(const data_t* data, index_t size) : Storage(size) {
-        std::memcpy(f_ptr, data, size*sizeof(data_t));
+    Storage::Storage(const data_t* data, index_t size, DType dtype) : Storage(size, dtype) {
+        dispatch(dtype, [&]<typename T>() {
+            std::transform(data, data+size, this->data<T>(), [](data_t v) { return from_data<T>(v); });
+        });
     }
 
     Storage::Storage(const std::initializer_list<data_t> &list) : Storage(list.size()) {
-        std::memcpy(f_ptr, list.begin(), size_*sizeof(data_t));
+        std::memcpy(raw(), list.begin(), size_*sizeof(data_t));
     }
-} // SimpleTensor
\ No newline at end of file
+
+    Storage::Storage(const std::shared_ptr<Data>& buffer, index_t size, index_t offset, DType dtype,
+                     bool read_only, bool writable, bool foreign) :
+            size_(size), b_ptr(Alloc::shared_construct<Block>(Block{0, buffer, read_only, writable, foreign})),
+            offset_(offset), dtype_(dtype) {}
+
+    Storage Storage::from_blob(void* data, index_t size, DType dtype, std::function<void(void*)> release) {
+        std::shared_ptr<Data> buffer(static_cast<Data*>(data), [release = std::move(release)](Data* ptr) {
+            if (release) release(ptr);
+        });
+        return Storage(buffer, size, 0, dtype, false, true, true);
+    }
+
+    Storage Storage::map_file(const std::string& path, DType dtype, MapMode mode, index_t offset, index_t size) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        CHECK_TRUE(fd >= 0, "Cannot open %s: %s", path.c_str(), std::strerror(errno));
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            THROW_ERROR("Cannot stat %s: %s", path.c_str(), std::strerror(errno));
+        }
+        index_t file_size = st.st_size;
+        if (size == 0) size = offset <= file_size ? (file_size-offset) / dtype_size(dtype) : 0;
+        if (size == 0 || offset + size*dtype_size(dtype) > file_size) {
+            ::close(fd);
+            THROW_ERROR("Cannot map %zu %s elements at byte %zu of %s with %zu bytes",
+                size, dtype_name(dtype), offset, path.c_str(), file_size);
+        }
+        // mmap wants a page aligned offset, so map from the page holding offset
+        index_t page = ::sysconf(_SC_PAGESIZE);
+        index_t base = offset / page * page;
+        index_t length = offset - base + size*dtype_size(dtype);
+        void* ptr = ::mmap(nullptr, length, mode == MapMode::ReadOnly ? PROT_READ : PROT_READ | PROT_WRITE,
+                           mode == MapMode::ReadOnly ? MAP_SHARED : MAP_PRIVATE, fd, (off_t)base);
+        ::close(fd); // the mapping keeps the file referenced
+        CHECK_TRUE(ptr != MAP_FAILED, "Cannot map %s: %s", path.c_str(), std::strerror(errno));
+        std::shared_ptr<Data> buffer(reinterpret_cast<Data*>(static_cast<char*>(ptr) + (offset-base)),
+                                     [ptr, length](Data*) { ::munmap(ptr, length); });
+        return Storage(buffer, size, 0, dtype, mode == MapMode::ReadOnly, mode != MapMode::ReadOnly);
+    }
+
+    Storage Storage::copy() const {
+        // sharing a blob would let the first write to it detach the blob from
+        // the caller's memory, so the copy gets its own buffer right away
+        if (b_ptr->foreign) {
+            index_t n_bytes = size_*dtype_size(dtype_);
+            auto buffer = Alloc::shared_allocate<Data>(n_bytes);
+            std::memcpy(buffer->data_, b_ptr->buffer->data_, n_bytes);
+            return Storage(buffer, size_, offset_, dtype_);
+        }
+        return Storage(b_ptr->buffer, size_, offset_, dtype_, b_ptr->read_only);
+    }
+
+    void Storage::refuse_write() const {
+        THROW_ERROR("Cannot write to a read-only mapping; clone() it or map it with MapMode::CopyOnWrite");
+    }
+
+    void Storage::detach() {
+        index_t n_bytes = size_*dtype_size(dtype_);
+        auto buffer = Alloc::shared_allocate<Data>(n_bytes);
+        std::memcpy(buffer->data_, b_ptr->buffer->data_, n_bytes);
+        b_ptr->buffer = std::move(buffer);
+        b_ptr->read_only = false;
+    }
+} // SimpleTensor
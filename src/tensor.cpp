@@ -1,7 +1,11 @@
+#include <algorithm>
+#include <cstring>
 #include <memory>
+#include <utility>
 #include "tensor.h"
 #include "exp.h"
 #include "exception.h"
+#include "parallel.h"
 
 namespace st
 {
@@ -10,8 +14,8 @@ namespace st
 		Exp<TensorImpl>(Alloc::unique_construct<TensorImpl>(storage, shape, stride)) {}
 	Tensor::Tensor(const Storage& storage, const Shape& shape) :
 		Exp<TensorImpl>(Alloc::unique_construct<TensorImpl>(storage, shape)) {}
-	Tensor::Tensor(const Shape& shape) :
-        Exp<TensorImpl>(Alloc::unique_construct<TensorImpl>(shape)) {}
+	Tensor::Tensor(const Shape& shape, DType dtype) :
+        Exp<TensorImpl>(Alloc::unique_construct<TensorImpl>(shape, dtype)) {}
 	Tensor::Tensor(const data_t* data, const Shape& shape) :
         Exp<TensorImpl>(Alloc::unique_construct<TensorImpl>(data, shape)) {}
 	Tensor::Tensor(Storage&& storage, Shape&& shape, IndexArray&& stride) :
@@ -21,309 +25,107 @@ namespace st
 	//operations
 	bool Tensor::is_contiguous() { return impl_ptr->is_contiguous(); }
 	data_t Tensor::item() const { return impl_ptr->item(); }
-	data_t Tensor::item(const int idx) const { return impl_ptr->item(idx); }
-	data_t &Tensor::operator[](std::initializer_list<index_t> dims) { return impl_ptr->operator[](dims); }
-	data_t Tensor::operator[](std::initializer_list<index_t> dims) const { return impl_ptr->operator[](dims); }
+	data_t Tensor::item(const index_t idx) const { return std::as_const(*impl_ptr).item(idx); }
+	ElementRef Tensor::operator[](std::initializer_list<index_t> dims) { return impl_ptr->operator[](dims); }
+	data_t Tensor::operator[](std::initializer_list<index_t> dims) const { return std::as_const(*impl_ptr)[dims]; }
 
-	Tensor Tensor::slice(index_t idx, index_t dim) const
-	{
-		return Tensor(impl_ptr->slice(idx, dim));
-	}
-	Tensor Tensor::slice(index_t start, index_t end, index_t dim) const
-	{
-		return Tensor(impl_ptr->slice(start, end, dim));
-	}
-	Tensor Tensor::view(const Shape& shape) const
-	{
-		return Tensor(impl_ptr->view(shape));
-	}
-	Tensor Tensor::transpose(index_t dim1, index_t dim2) const
-	{
-		return Tensor(impl_ptr->transpose(dim1, dim2));
-	}
-	Tensor Tensor::permute(std::initializer_list<index_t> dims) const
-	{
-		return Tensor(impl_ptr->permute(dims));
-	}
-    Tensor Tensor::sum(int idx) const {
-        return Tensor(impl_ptr->sum(idx));
-    }
-	std::ostream& operator<<(std::ostream& out, const Tensor& tensor)
-	{
-		out << *tensor.impl_ptr;
-		return out;
-	}
-
-
-	//iterator
-	Tensor::iterator::iterator(Tensor* tensor, std::vector<index_t> idx)
+	Tensor& Tensor::operator+=(data_t value)
 	{
-        CHECK_EQUAL(idx.size(), tensor->n_dim(), "Index size not match.");
-		_tensor = tensor;
-        for (index_t i = 0; i < idx.size(); ++i) {
-            CHECK_IN_RANGE(i, 0, tensor->size()[i], "Index out of range.");
-            _idx.push_back(idx[i]);
-        }
-	}
-
-	Tensor::iterator& Tensor::iterator::operator++()
-	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_TRUE(*this != _tensor->end(), "Iterator out of range.");
-		int cnt = 0;
-		for (int i = (int)_idx.size()-1; i >= 0; --i)
-		{
-			if (_idx[i]+1 < _tensor->size()[i])
-			{
-				++_idx[i];
-				break;
-			}
-			else
-			{
-				_idx[i] = 0;
-				++cnt;
-			}
-		}
-		if (cnt == _idx.size())
-		{
-			for (int i = 0; i < _idx.size(); ++i)
-			{
-				_idx[i] = _tensor->size()[i];
-			}
-		}
+		impl_ptr->compound_assign<op::Add>(value);
 		return *this;
 	}
-
-	Tensor::iterator Tensor::iterator::operator++(int)
+	Tensor& Tensor::operator-=(data_t value)
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_TRUE(*this != _tensor->end(), "Iterator out of range.");
-		iterator tmp = *this;
-		++*this;
-		return tmp;
+		impl_ptr->compound_assign<op::Sub>(value);
+		return *this;
 	}
-
-	Tensor::iterator& Tensor::iterator::operator--()
+	Tensor& Tensor::operator*=(data_t value)
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_TRUE(*this != _tensor->begin(), "Iterator out of range.");
-		if (*this == _tensor->end())
-		{
-			for (int i = 0; i < _idx.size(); ++i)
-			{
-				_idx[i] = _tensor->size()[i]-1;
-			}
-			return *this;
-		}
-		for (int i = 0; i < _idx.size(); --i)
-		{
-			if (_idx[i] > 0)
-			{
-				--_idx[i];
-				break;
-			}
-			else
-			{
-				_idx[i] = _tensor->size()[i]-1;
-			}
-		}
+		impl_ptr->compound_assign<op::Mul>(value);
 		return *this;
 	}
-
-	Tensor::iterator Tensor::iterator::operator--(int)
+	Tensor& Tensor::operator/=(data_t value)
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_TRUE(*this != _tensor->begin(), "Iterator out of range.");
-		iterator tmp = *this;
-		--*this;
-		return tmp;
+		impl_ptr->compound_assign<op::Div>(value);
+		return *this;
 	}
 
-	bool Tensor::iterator::operator==(const iterator& other) const
+	Tensor Tensor::clone() const
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_EQUAL(other._idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_EQUAL(_tensor, other._tensor, "Tensor not match.");
-		return _idx == other._idx;
+		return Tensor(impl_ptr->clone());
 	}
-
-	bool Tensor::iterator::operator!=(const iterator& other) const
+	Tensor Tensor::to(DType dtype) const
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_EQUAL(other._idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_EQUAL(_tensor, other._tensor, "Tensor not match.");
-		return !(*this == other);
+		return Tensor(impl_ptr->to(dtype));
 	}
-
-	Tensor::iterator::reference Tensor::iterator::operator*() const
+	Tensor Tensor::contiguous() const
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_TRUE(*this != _tensor->end(), "Iterator out of range.");
-		index_t idx = 0;
-		for (int i = 0; i < _idx.size(); ++i)
-		{
-			idx += _idx[i] * _tensor->impl_ptr->stride()[i];
-		}
-		return _tensor->impl_ptr->item(idx);
+		if (impl_ptr->is_contiguous()) return *this;
+		return Tensor(impl_ptr->contiguous());
 	}
-
-	Tensor::iterator::pointer Tensor::iterator::operator->() const
+	Tensor Tensor::slice(index_t idx, index_t dim) const
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_TRUE(*this != _tensor->end(), "Iterator out of range.");
-		return &**this;
+		return Tensor(impl_ptr->slice(idx, dim));
 	}
-
-	//const_iterator
-	Tensor::const_iterator::const_iterator(const Tensor* tensor, std::vector<index_t> idx)
+	Tensor Tensor::slice(index_t start, index_t end, index_t dim) const
 	{
-        CHECK_EQUAL(idx.size(), tensor->n_dim(), "Index size not match.");
-		_tensor = tensor;
-		for (index_t i = 0; i < idx.size(); ++i) {
-            CHECK_IN_RANGE(i, 0, tensor->size()[i], "Index out of range.");
-            _idx.push_back(idx[i]);
-        }
+		return Tensor(impl_ptr->slice(start, end, dim));
 	}
-	Tensor::const_iterator& Tensor::const_iterator::operator++()
+	Tensor Tensor::slice(std::optional<int64_t> start, std::optional<int64_t> end, int64_t step, index_t dim) const
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_TRUE(*this != _tensor->end(), "Iterator out of range.");
-        int cnt = 0;
-		for (int i = (int)_idx.size()-1; i >= 0; --i)
-		{
-			if (_idx[i]+1 < _tensor->size()[i])
-			{
-				++_idx[i];
-				break;
-			}
-			else
-			{
-				_idx[i] = 0;
-				++cnt;
-			}
-		}
-		if (cnt == _idx.size())
-		{
-			for (int i = 0; i < _idx.size(); ++i)
-			{
-				_idx[i] = _tensor->size()[i];
-			}
-		}
-		return *this;
+		return Tensor(impl_ptr->slice(Slice{start, end, step}, dim));
 	}
-
-	Tensor::const_iterator Tensor::const_iterator::operator++(int)
+	Tensor Tensor::slice(std::initializer_list<Slice> ranges) const
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_TRUE(*this != _tensor->end(), "Iterator out of range.");
-        const_iterator tmp = *this;
-		++*this;
-		return tmp;
+		return Tensor(impl_ptr->slice(ranges));
 	}
-
-	Tensor::const_iterator& Tensor::const_iterator::operator--()
+	Tensor Tensor::view(const Shape& shape) const
 	{
-		CHECK_IN_RANGE(_idx.size(), 0, _tensor->n_dim(), "Index out of range.");
-        CHECK_TRUE(*this != _tensor->begin(), "Iterator out of range.");
-        if (*this == _tensor->end())
-		{
-			for (int i = 0; i < _idx.size(); ++i)
-			{
-				_idx[i] = _tensor->size()[i]-1;
-			}
-			return *this;
-		}
-		for (int i = 0; i < _idx.size(); --i)
-		{
-			if (_idx[i] > 0)
-			{
-				--_idx[i];
-				break;
-			}
-			else
-			{
-				_idx[i] = _tensor->size()[i]-1;
-			}
-		}
-		return *this;
+		return Tensor(impl_ptr->view(shape));
 	}
-
-	Tensor::const_iterator Tensor::const_iterator::operator--(int)
+	Tensor Tensor::reshape(const Shape& shape) const
 	{
-		CHECK_IN_RANGE(_idx.size(), 0, _tensor->n_dim(), "Index out of range.");
-        CHECK_TRUE(*this != _tensor->begin(), "Iterator out of range.");
-        const_iterator tmp = *this;
-		--*this;
-		return tmp;
+		return Tensor(impl_ptr->reshape(shape));
 	}
-
-	bool Tensor::const_iterator::operator==(const const_iterator& other) const
+	Tensor Tensor::transpose(index_t dim1, index_t dim2) const
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_EQUAL(other._idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_EQUAL(_tensor, other._tensor, "Tensor not match.");
-        return _idx == other._idx && _tensor == other._tensor;
+		return Tensor(impl_ptr->transpose(dim1, dim2));
 	}
-
-	bool Tensor::const_iterator::operator!=(const const_iterator& other) const
+	Tensor Tensor::permute(std::initializer_list<index_t> dims) const
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_EQUAL(other._idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_EQUAL(_tensor, other._tensor, "Tensor not match.");
-        return !(*this == other);
+		return Tensor(impl_ptr->permute(dims));
 	}
-
-	Tensor::const_iterator::const_reference Tensor::const_iterator::operator*() const
+	Tensor Tensor::expand(const Shape& shape) const
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_TRUE(*this != _tensor->end(), "Iterator out of range.");
-        index_t idx = 0;
-		for (int i = 0; i < _idx.size(); ++i)
-		{
-			idx += _idx[i] * _tensor->impl_ptr->stride()[i];
-		}
-		return _tensor->impl_ptr->item(idx);
+		return Tensor(impl_ptr->expand(shape));
 	}
-
-	Tensor::const_iterator::const_pointer Tensor::const_iterator::operator->() const
+	Tensor Tensor::squeeze() const
 	{
-        CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
-        CHECK_TRUE(*this != _tensor->end(), "Iterator out of range.");
-        return &**this;
+		return Tensor(impl_ptr->squeeze());
 	}
-	//iterator_methods
-
-	Tensor::iterator Tensor::begin()
+	Tensor Tensor::squeeze(index_t dim) const
 	{
-		return iterator(this, std::vector<index_t>(impl_ptr->n_dim()));
+		return Tensor(impl_ptr->squeeze(dim));
 	}
-
-	Tensor::iterator Tensor::end()
+	Tensor Tensor::unsqueeze(index_t dim) const
 	{
-		std::vector<index_t> idx;
-		for (int i = 0; i < impl_ptr->n_dim(); ++i)
-		{
-			idx.push_back(impl_ptr->size()[i]);
-		}
-		return iterator(this, idx);
+		return Tensor(impl_ptr->unsqueeze(dim));
 	}
-
-	Tensor::const_iterator Tensor::begin() const
+    Tensor Tensor::sum(int idx) const {
+        return Tensor(impl_ptr->sum(idx));
+    }
+	Tensor& Tensor::sum(int idx, Tensor& out) const
 	{
-		return const_iterator(this, std::vector<index_t>(impl_ptr->n_dim()));
+		impl_ptr->sum(idx, *out.impl_ptr);
+		return out;
 	}
-
-	Tensor::const_iterator Tensor::end() const
+	std::ostream& operator<<(std::ostream& out, const Tensor& tensor)
 	{
-		std::vector<index_t> idx;
-		for (int i = 0; i < impl_ptr->n_dim(); ++i)
-		{
-			idx.push_back(impl_ptr->size()[i]);
-		}
-		return const_iterator(this, idx);
+		out << *tensor.impl_ptr;
+		return out;
 	}
 
-	data_t Tensor::eval(IndexArray idx) const
+	data_t Tensor::eval(const IndexArray& idx) const
 	{
         return impl_ptr->eval(idx);
 	}
@@ -332,14 +134,17 @@ namespace st
         return impl_ptr->sum();
     }
 
-    Tensor Tensor::rand(const st::Shape &shape) {
-        return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::rand(shape)));
+    Tensor Tensor::rand(const st::Shape &shape, DType dtype) {
+        return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::rand(shape, dtype)));
+    }
+    Tensor Tensor::empty(const st::Shape &shape, DType dtype) {
+        return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::empty(shape, dtype)));
     }
-    Tensor Tensor::ones(const st::Shape &shape) {
-        return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::ones(shape)));
+    Tensor Tensor::ones(const st::Shape &shape, DType dtype) {
+        return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::ones(shape, dtype)));
     }
-    Tensor Tensor::zeros(const st::Shape &shape) {
-        return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::zeros(shape)));
+    Tensor Tensor::zeros(const st::Shape &shape, DType dtype) {
+        return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::zeros(shape, dtype)));
     }
 	Tensor Tensor::zeros_like(const st::Tensor& tensor)
 	{
@@ -353,11 +158,152 @@ namespace st
 	{
 		return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::rand_like(*(tensor.impl_ptr))));
 	}
-    Tensor Tensor::randn(const Shape &shape) {
-        return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::randn(shape)));
+    Tensor Tensor::randn(const Shape &shape, DType dtype) {
+        return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::randn(shape, dtype)));
     }
     Tensor Tensor::randn_like(const Tensor &tensor) {
         return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::randn_like(*(tensor.impl_ptr))));
     }
 
+    Tensor Tensor::from_blob(void* data, const Shape& shape, const IndexArray& stride,
+                             std::function<void(void*)> release, DType dtype) {
+        CHECK_NOT_NULL(data, "from_blob() expects a non-null data pointer");
+        CHECK_EQUAL(shape.n_dim(), stride.size(),
+            "Expected %zu strides for a %zuD tensor, but got %zu", shape.n_dim(), shape.n_dim(), stride.size());
+        for (index_t i = 0; i < shape.n_dim(); ++i)
+            CHECK_TRUE((stride_t)stride[i] >= 0, "from_blob() expects non-negative strides, but got %td on dimension %zu",
+                (stride_t)stride[i], i);
+        // elements up to the last one; an empty tensor refers to none
+        index_t size = 0;
+        if (shape.d_size() > 0) {
+            size = 1;
+            for (index_t i = 0; i < shape.n_dim(); ++i)
+                size += (shape[i]-1) * stride[i];
+        }
+        return Tensor(Storage::from_blob(data, size, dtype, std::move(release)), shape, stride);
+    }
+    Tensor Tensor::from_blob(void* data, const Shape& shape, std::function<void(void*)> release, DType dtype) {
+        CHECK_NOT_NULL(data, "from_blob() expects a non-null data pointer");
+        return Tensor(Storage::from_blob(data, shape.d_size(), dtype, std::move(release)), shape);
+    }
+
+    void Tensor::check_accessor(DType dtype, index_t rank) const {
+        CHECK_TRUE(dtype == this->dtype(), "Expected an accessor of %s, but got %s",
+            dtype_name(this->dtype()), dtype_name(dtype));
+        CHECK_EQUAL(rank, n_dim(), "Expected an accessor of rank %zu, but got %zu", n_dim(), rank);
+    }
+
+    void Tensor::check_values(DType dtype, bool contiguous) const {
+        CHECK_TRUE(dtype == this->dtype(), "Expected elements of %s, but got %s",
+            dtype_name(this->dtype()), dtype_name(dtype));
+        CHECK_TRUE(!contiguous || impl_ptr->is_contiguous(), "values() needs a contiguous tensor");
+    }
+
+    Tensor Tensor::map_file(const std::string& path, const Shape& shape, DType dtype, MapMode mode, index_t offset) {
+        return Tensor(Storage::map_file(path, dtype, mode, offset, shape.d_size()), shape);
+    }
+
+    namespace {
+        constexpr index_t COPY_CHUNK = 1 << 16; // bytes per memcpy handed to one thread
+
+        Shape cat_size(const std::vector<Tensor>& tensors, index_t dim) {
+            CHECK_TRUE(!tensors.empty(), "cat() expects a non-empty list of tensors");
+            const Tensor& first = tensors[0];
+            CHECK_IN_RANGE(dim, 0, first.n_dim(),
+                "Dimension out of range (expected to be in range of [0, %zu), but got %zu)", first.n_dim(), dim);
+            Shape shape(first.size());
+            shape[dim] = 0;
+            for (const Tensor& tensor : tensors) {
+                CHECK_EQUAL(tensor.n_dim(), first.n_dim(),
+                    "Tensors must have the same number of dimensions, but got %zuD and %zuD",
+                    first.n_dim(), tensor.n_dim());
+                CHECK_TRUE(tensor.dtype() == first.dtype(), "Expected all tensors to be %s, but got %s",
+                    dtype_name(first.dtype()), dtype_name(tensor.dtype()));
+                for (index_t i = 0; i < first.n_dim(); ++i)
+                    CHECK_TRUE(i == dim || tensor.size(i) == first.size(i),
+                        "Sizes of tensors must match except in dimension %zu, but got %zu and %zu in dimension %zu",
+                        dim, first.size(i), tensor.size(i), i);
+                shape[dim] += tensor.size(dim);
+            }
+            return shape;
+        }
+
+        // stacking is joining views with a size 1 dimension inserted at dim
+        std::vector<Tensor> stack_parts(const std::vector<Tensor>& tensors, index_t dim) {
+            CHECK_TRUE(!tensors.empty(), "stack() expects a non-empty list of tensors");
+            std::vector<Tensor> parts;
+            for (const Tensor& tensor : tensors) {
+                CHECK_TRUE(tensor.size() == tensors[0].size(), "stack() expects tensors of the same shape");
+                parts.push_back(tensor.unsqueeze(dim));
+            }
+            return parts;
+        }
+    }
+
+    Tensor cat(const std::vector<Tensor>& tensors, index_t dim) {
+        Shape shape = cat_size(tensors, dim);
+        Tensor out = Tensor::empty(shape, tensors[0].dtype());
+        cat(tensors, dim, out);
+        return out;
+    }
+
+    Tensor& cat(const std::vector<Tensor>& tensors, index_t dim, Tensor& out) {
+        Shape shape = cat_size(tensors, dim);
+        CHECK_TRUE(out.size() == shape, "cat() output has the wrong shape");
+        if (out.dtype() != tensors[0].dtype() || !out.ptr()->is_contiguous()) {
+            // converting or strided output: assign each part into its view of out
+            index_t pos = 0;
+            for (const Tensor& tensor : tensors) {
+                Tensor part = out.slice(pos, pos + tensor.size(dim), dim);
+                eval_into(part, tensor);
+                pos += tensor.size(dim);
+            }
+            return out;
+        }
+
+        // Each index into the dimensions before dim selects a row of out made of
+        // the matching rows of the inputs one after another. Every input row is
+        // one memcpy, split into COPY_CHUNK pieces so that a few big inputs
+        // still spread over the threads.
+        index_t n = tensors.size(), elem = dtype_size(out.dtype());
+        index_t outer = shape.sub_size(0, dim), inner = shape.sub_size(dim+1);
+        index_t row_bytes = shape[dim] * inner * elem;
+        std::vector<Tensor> src;
+        std::vector<const char*> src_ptr(n);
+        std::vector<index_t> run(n), chunks(n), pos(n), first_item(n+1, 0);
+        for (index_t i = 0; i < n; ++i) {
+            const Tensor& tensor = tensors[i];
+            // strided inputs go through the tiled copy first, inputs sharing
+            // memory with out are copied out of the way
+            src.push_back(tensor.ptr()->overlaps(*out.ptr(), false) ? tensor.to(tensor.dtype()) : tensor.contiguous());
+            run[i] = tensor.size(dim) * inner * elem;
+            chunks[i] = std::max<index_t>(1, (run[i] + COPY_CHUNK - 1) / COPY_CHUNK);
+            pos[i] = i == 0 ? 0 : pos[i-1] + run[i-1];
+            first_item[i+1] = first_item[i] + outer * chunks[i];
+        }
+        char* dst = static_cast<char*>(out.ptr()->storage().raw());
+        for (index_t i = 0; i < n; ++i)
+            src_ptr[i] = static_cast<const char*>(std::as_const(*src[i].ptr()).storage().raw());
+
+        parallel_for(first_item[n], shape.d_size(), [&](index_t begin, index_t end) {
+            index_t i = std::upper_bound(first_item.begin(), first_item.end(), begin) - first_item.begin() - 1;
+            for (index_t item = begin; item < end; ++item) {
+                while (item >= first_item[i+1]) ++i;
+                index_t o = (item - first_item[i]) / chunks[i];
+                index_t lo = (item - first_item[i]) % chunks[i] * COPY_CHUNK;
+                index_t hi = std::min(lo + COPY_CHUNK, run[i]);
+                std::memcpy(dst + o*row_bytes + pos[i] + lo, src_ptr[i] + o*run[i] + lo, hi - lo);
+            }
+        });
+        return out;
+    }
+
+    Tensor stack(const std::vector<Tensor>& tensors, index_t dim) {
+        return cat(stack_parts(tensors, dim), dim);
+    }
+
+    Tensor& stack(const std::vector<Tensor>& tensors, index_t dim, Tensor& out) {
+        return cat(stack_parts(tensors, dim), dim, out);
+    }
+
 } // SimpleTensor
\ No newline at end of file
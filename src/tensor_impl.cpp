@@ -1,14 +1,75 @@
 #include "tensor_impl.h"
 #include "exception.h"
+#include "parallel.h"
+#include <algorithm>
 #include <memory>
 #include <cmath>
 #include <iomanip>
 #include <random>
 #include <ctime>
+#include <vector>
 
 #define debug printf("%d %s\n", __LINE__, __FUNCTION__)
 
 namespace st {
+    namespace {
+        constexpr index_t COPY_TILE = 32;
+
+        // copies rows [r_begin, r_end) of a rows x cols block with source strides
+        // (s0, s1) into a row-major destination, a tile at a time so that both
+        // sides stay in cache when the block is transposed
+        template<typename T>
+        void copy_rows(const T* src, T* dst, index_t r_begin, index_t r_end, index_t cols,
+                       index_t s0, index_t s1) {
+            if (s1 == 1) {
+                for (index_t r = r_begin; r < r_end; ++r)
+                    std::memcpy(dst + r*cols, src + r*s0, cols*sizeof(T));
+                return;
+            }
+            for (index_t c0 = 0; c0 < cols; c0 += COPY_TILE) {
+                index_t c1 = std::min(c0 + COPY_TILE, cols);
+                // read along the source's contiguous direction
+                if (std::abs((stride_t)s0) < std::abs((stride_t)s1)) {
+                    for (index_t c = c0; c < c1; ++c)
+                        for (index_t r = r_begin; r < r_end; ++r)
+                            dst[r*cols + c] = src[r*s0 + c*s1];
+                } else {
+                    for (index_t r = r_begin; r < r_end; ++r)
+                        for (index_t c = c0; c < c1; ++c)
+                            dst[r*cols + c] = src[r*s0 + c*s1];
+                }
+            }
+        }
+
+        // dst = src laid out row-major, over a loop nest in logical order whose
+        // second operand is src. The two innermost dimensions are copied in
+        // bands of COPY_TILE rows; bands across the outer dimensions are split
+        // between threads for large tensors.
+        template<typename T>
+        void strided_copy(const T* src, T* dst, const LoopNest<2>& loop) {
+            const std::vector<index_t>& shape = loop.shape;
+            const std::vector<index_t>& stride = loop.stride[1];
+            index_t n = loop.n_dim(), size = loop.rows() * loop.cols();
+            if (size == 0) return;
+            index_t rows = n > 1 ? shape[n-2] : 1, cols = shape[n-1];
+            index_t s0 = n > 1 ? stride[n-2] : 0, s1 = stride[n-1];
+            index_t outer = size / (rows*cols);
+            index_t bands = (rows + COPY_TILE - 1) / COPY_TILE;
+
+            auto run = [&](index_t begin, index_t end) {
+                for (index_t item = begin; item < end; ++item) {
+                    index_t o = item / bands, band = item % bands;
+                    index_t src_offset = 0;
+                    for (index_t i = n-2, rest = o; n > 2 && i-- > 0; rest /= shape[i])
+                        src_offset += rest % shape[i] * stride[i];
+                    copy_rows(src + src_offset, dst + o*rows*cols, band*COPY_TILE,
+                              std::min((band+1)*COPY_TILE, rows), cols, s0, s1);
+                }
+            };
+            parallel_for(outer * bands, size, run);
+        }
+    }
+
     // constructor
     TensorImpl::TensorImpl(const Storage& storage, const Shape& shape, const IndexArray& stride) :
         _storage(storage), _shape(shape), _stride(stride) {}
@@ -20,10 +81,8 @@ namespace st {
             if (shape[i] == 1) _stride[i] = 0;
         }
     }
-    TensorImpl::TensorImpl(const Shape& shape) :
-        _storage(shape.d_size()), _shape(shape), _stride(shape.n_dim()) {
-        for (int i = 0; i < shape.d_size(); ++i)
-            _storage[i] = 0;
+    TensorImpl::TensorImpl(const Shape& shape, DType dtype) :
+        _storage(shape.d_size(), (data_t)0, dtype), _shape(shape), _stride(shape.n_dim()) {
         for (int i = 0; i < shape.n_dim(); ++i) {
             if (i == shape.n_dim()-1) _stride[i] = 1;
             else _stride[i] = shape.sub_size(i+1);
@@ -31,9 +90,7 @@ namespace st {
         }
     }
     TensorImpl::TensorImpl(const data_t* data, const Shape& shape) :
-        _storage(shape.d_size()), _shape(shape), _stride(shape.n_dim()) {
-        for (int i = 0; i < shape.d_size(); ++i)
-            _storage[i] = data[i];
+        _storage(data, shape.d_size()), _shape(shape), _stride(shape.n_dim()) {
         for (int i = 0; i < shape.n_dim(); ++i) {
             if (i == shape.n_dim()-1) _stride[i] = 1;
             else _stride[i] = shape.sub_size(i+1);
@@ -46,21 +103,35 @@ namespace st {
     // method
     bool TensorImpl::is_contiguous() const
 	{
-        for (int i = 0; i < n_dim()-1; ++i) {
+        // dimensions of size 1 are never stepped over, whatever their stride
+        for (index_t i = 0; i < n_dim(); ++i) {
             if (_shape[i] == 1) continue;
             if (_stride[i] != _shape.sub_size(i+1)) return false;
         }
-        if (_stride[n_dim()-1] != 1) return false;
         return true;
     }
 
-    data_t& TensorImpl::operator[](std::initializer_list<index_t> dims) {
+    index_t TensorImpl::extent() const {
+        index_t res = 0;
+        for (index_t i = 0; i < n_dim(); ++i)
+            if ((stride_t)_stride[i] > 0) res += (_shape[i]-1) * _stride[i];
+        return res;
+    }
+
+    index_t TensorImpl::back_extent() const {
+        index_t res = 0;
+        for (index_t i = 0; i < n_dim(); ++i)
+            if ((stride_t)_stride[i] < 0) res -= (_shape[i]-1) * _stride[i];
+        return res;
+    }
+
+    ElementRef TensorImpl::operator[](std::initializer_list<index_t> dims) {
 		CHECK_EQUAL(n_dim(), dims.size(),
-				"Invalid %zuD indices for %dD tensor", dims.size(), n_dim());
+				"Invalid %zuD indices for %zuD tensor", dims.size(), n_dim());
         index_t index = 0, dim = 0;
         for (auto v : dims) {
             CHECK_IN_RANGE(v, 0, size(dim),
-                           "Index out of range (expected to be in range of [0, %d), but got %d)",
+                           "Index out of range (expected to be in range of [0, %zu), but got %zu)",
                            size(dim), v);
             index += v*_stride[dim];
             ++dim;
@@ -69,17 +140,15 @@ namespace st {
     }
     data_t TensorImpl::operator[](std::initializer_list<index_t> dims) const {
 		CHECK_EQUAL(n_dim(), dims.size(),
-			"Invalid %zuD indices for %dD tensor", dims.size(), n_dim());
+			"Invalid %zuD indices for %zuD tensor", dims.size(), n_dim());
         index_t index = 0, dim = 0;
         for (auto v : dims) {
-            std::cout << v << " ";
             CHECK_IN_RANGE(v, 0, size(dim),
-                           "Index out of range (expected to be in range of [0, %d), but got %d)",
+                           "Index out of range (expected to be in range of [0, %zu), but got %zu)",
                            size(dim), v);
             index += v*_stride[dim];
             ++dim;
         }
-        std::cout << std::endl;
         return _storage[index];
     }
 
@@ -93,29 +162,84 @@ namespace st {
         return _storage[idx];
 	}
 
-	data_t& TensorImpl::item(index_t idx)
+	ElementRef TensorImpl::item(index_t idx)
 	{
 		return _storage[idx];
 	}
-	data_t TensorImpl::eval(IndexArray idx) const {
-        int index = 0;
+	data_t TensorImpl::eval(const IndexArray& idx) const {
+        index_t index = 0;
         if (idx.size() >= _shape.n_dim()) {
-            for (int i = idx.size() - n_dim(); i < idx.size(); ++i)
+            for (index_t i = idx.size() - n_dim(); i < idx.size(); ++i)
                 index += idx[i]*_stride[i-(idx.size()-n_dim())];
         } else {
-            for (int i = 0; i < idx.size(); ++i)
+            for (index_t i = 0; i < idx.size(); ++i)
                 index += idx[i]*_stride[i+(n_dim()-idx.size())];
         }
         return item(index);
     }
 
+    bool TensorImpl::is_flat(const Shape& shape) const {
+        return d_size() == 1 || (_shape == shape && is_contiguous());
+    }
+
+    bool TensorImpl::overlaps(const TensorImpl& dst, bool elementwise) const {
+        if (!_storage.is_shared_with(dst._storage)) return false;
+        // views over disjoint parts of the buffer never interfere
+        if (offset() + extent() < dst.offset() - dst.back_extent() ||
+            dst.offset() + dst.extent() < offset() - back_extent()) return false;
+        if (!elementwise || !(_shape == dst._shape)) return true;
+        for (index_t i = 0; i < n_dim(); ++i)
+            if (_stride[i] != dst._stride[i]) return true;
+        // same layout: the destination is walked forward, so reading the element
+        // it is about to write or one further ahead is fine
+        return offset() < dst.offset() || (offset() > dst.offset() && !is_contiguous());
+    }
+
+    const data_t* TensorImpl::eval_block(index_t start, index_t n, data_t* buf) const {
+        if (d_size() == 1) {
+            std::fill_n(buf, n, _storage[0]);
+            return buf;
+        }
+        if (dtype() == DType::Float64)
+            return _storage.data()+start;
+        dispatch(dtype(), [&]<typename T>() {
+            load_block(_storage.data<T>()+start, buf, n);
+        });
+        return buf;
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::clone() const {
+        return Alloc::unique_construct<TensorImpl>(_storage.copy(), _shape, _stride);
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::to(DType dtype) const {
+        Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
+        ptr = Alloc::unique_construct<TensorImpl>(Storage(d_size(), dtype), _shape);
+        *ptr = this;
+        return ptr;
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::contiguous() const {
+        Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
+        ptr = Alloc::unique_construct<TensorImpl>(Storage(d_size(), dtype()), _shape);
+        // merged dimensions leave fewer, longer rows to copy
+        LoopNest<2> loop = make_loop<2>(_shape, {&ptr->_stride, &_stride}, false);
+        dispatch(dtype(), [&]<typename T>() {
+            strided_copy(_storage.data<T>(), ptr->_storage.data<T>(), loop);
+        });
+        return ptr;
+    }
+
     Alloc::NonTrivalUniquePtr<TensorImpl>
     TensorImpl::slice(index_t idx, index_t dim) const {
 		CHECK_IN_RANGE(dim, 0, n_dim(),
-			"Dimension out of range (expected to be in range of [0, %d), but got %d)",
+			"Dimension out of range (expected to be in range of [0, %zu), but got %zu)",
 			n_dim(), dim);
 		CHECK_IN_RANGE(idx, 0, size(dim),
-			"Index %d is out of bound for dimension %d with size %d",
+			"Index %zu is out of bound for dimension %zu with size %zu",
 			idx, dim, size(dim));
         Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
         ptr = Alloc::unique_construct<TensorImpl>(
@@ -129,13 +253,13 @@ namespace st {
     Alloc::NonTrivalUniquePtr<TensorImpl>
     TensorImpl::slice(index_t start_idx, index_t end_idx, index_t dim) const {
 		CHECK_IN_RANGE(dim, 0, n_dim(),
-			"Dimension out of range (expected to be in range of [0, %d), but got %d)",
+			"Dimension out of range (expected to be in range of [0, %zu), but got %zu)",
 			n_dim(), dim);
 		CHECK_IN_RANGE(start_idx, 0, size(dim),
-			"Index %d is out of bound for dimension %d with size %d",
+			"Index %zu is out of bound for dimension %zu with size %zu",
 			start_idx, dim, size(dim));
 		CHECK_IN_RANGE(end_idx, 0, size(dim)+1,
-			"Range end %d is out of bound for dimension %d with size %d",
+			"Range end %zu is out of bound for dimension %zu with size %zu",
 			end_idx, dim, size(dim));
         CHECK_TRUE(start_idx < end_idx,
                    "slice() expects the start index must be smaller than the end index");
@@ -144,16 +268,56 @@ namespace st {
                 Storage(_storage, offset() + start_idx * _stride[dim]),
                 _shape, _stride);
         ptr->_shape[dim] = end_idx-start_idx;
+        if (end_idx-start_idx == 1) ptr->_stride[dim] = 0; // so that it broadcasts
+        return ptr;
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::slice(const Slice& range, index_t dim) const {
+        CHECK_IN_RANGE(dim, 0, n_dim(),
+            "Dimension out of range (expected to be in range of [0, %zu), but got %zu)",
+            n_dim(), dim);
+        CHECK_TRUE(range.step != 0, "slice() step cannot be zero");
+        auto size = (int64_t)_shape[dim];
+        // bounds are clamped into [lower, upper] as Python does
+        int64_t lower = range.step > 0 ? 0 : -1, upper = range.step > 0 ? size : size-1;
+        auto bound = [&](std::optional<int64_t> idx, int64_t missing) {
+            if (!idx) return missing;
+            return std::clamp(*idx < 0 ? *idx + size : *idx, lower, upper);
+        };
+        int64_t start = bound(range.start, range.step > 0 ? lower : upper);
+        int64_t end = bound(range.end, range.step > 0 ? upper : lower);
+        int64_t len = range.step > 0 ? (end - start + range.step - 1) / range.step
+                                     : (start - end - range.step - 1) / -range.step;
+        CHECK_TRUE(len > 0, "slice() selects no elements from dimension %zu with size %zu", dim, _shape[dim]);
+
+        Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
+        ptr = Alloc::unique_construct<TensorImpl>(
+                Storage(_storage, offset() + start * _stride[dim]),
+                _shape, _stride);
+        ptr->_shape[dim] = len;
+        ptr->_stride[dim] = len == 1 ? 0 : _stride[dim] * (index_t)range.step;
+        return ptr;
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::slice(std::initializer_list<Slice> ranges) const {
+        CHECK_TRUE(ranges.size() <= n_dim(),
+            "Too many ranges (%zu) for a %zuD tensor", ranges.size(), n_dim());
+        auto ptr = Alloc::unique_construct<TensorImpl>(*this);
+        index_t dim = 0;
+        for (const Slice& range : ranges)
+            ptr = ptr->slice(range, dim++);
         return ptr;
     }
 
     Alloc::NonTrivalUniquePtr<TensorImpl>
     TensorImpl::transpose(index_t dim1, index_t dim2) const {
 		CHECK_IN_RANGE(dim1, 0, n_dim(),
-			"Dimension out of range (expected to be in range of [0, %d), but got %d)",
+			"Dimension out of range (expected to be in range of [0, %zu), but got %zu)",
 			n_dim(), dim1);
 		CHECK_IN_RANGE(dim2, 0, n_dim(),
-			"Dimension out of range (expected to be in range of [0, %d), but got %d)",
+			"Dimension out of range (expected to be in range of [0, %zu), but got %zu)",
 			n_dim(), dim2);
         Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
         ptr = Alloc::unique_construct<TensorImpl>(_storage, _shape, _stride);
@@ -164,25 +328,62 @@ namespace st {
 
     Alloc::NonTrivalUniquePtr<TensorImpl>
     TensorImpl::view(const Shape &shape) const {
-        CHECK_TRUE( !is_contiguous(),
-            "view() is only supported to contiguous tensor");
-        CHECK_EQUAL(shape.d_size(), shape.d_size(),
-            "Shape of size %d is invalid for input tensor with size %d",
-            shape.d_size(), shape.d_size());
-        Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
-        ptr = Alloc::unique_construct<TensorImpl>(_storage, shape);
-        for (int i = 0; i < shape.n_dim(); ++i) {
-            if (i+1 < shape.n_dim()) ptr->_stride[i] = shape.sub_size(i+1);
-            else ptr->_stride[i] = 1;
-			if (shape[i] == 1) ptr->_stride[i] = 0;
+        CHECK_EQUAL(shape.d_size(), d_size(),
+            "Shape of size %zu is invalid for input tensor with size %zu",
+            shape.d_size(), d_size());
+        IndexArray stride(shape.n_dim());
+        CHECK_TRUE(view_stride(shape, stride),
+            "View size is not compatible with input tensor's size and stride, use reshape() instead");
+        return Alloc::unique_construct<TensorImpl>(_storage, shape, stride);
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::reshape(const Shape &shape) const {
+        CHECK_EQUAL(shape.d_size(), d_size(),
+            "Shape of size %zu is invalid for input tensor with size %zu",
+            shape.d_size(), d_size());
+        IndexArray stride(shape.n_dim());
+        if (view_stride(shape, stride))
+            return Alloc::unique_construct<TensorImpl>(_storage, shape, stride);
+        return Alloc::unique_construct<TensorImpl>(contiguous()->_storage, shape);
+    }
+
+    bool TensorImpl::view_stride(const Shape& shape, IndexArray& stride) const {
+        // The old dimensions fall into chunks whose elements sit at equal steps
+        // (stride[i] == size[i+1]*stride[i+1]). Each chunk may be split into new
+        // dimensions freely, as long as no new dimension straddles two chunks.
+        index_t new_dim = shape.n_dim();
+        index_t base = 0, old_size = 1, new_size = 1;
+        for (index_t i = n_dim(); i-- > 0; ) {
+            if (_shape[i] == 1) continue;
+            if (old_size == 1) base = _stride[i];
+            old_size *= _shape[i];
+            // keep going while the next non-trivial dimension continues the chunk
+            index_t j = i;
+            while (j > 0 && _shape[j-1] == 1) --j;
+            if (j > 0 && _stride[j-1] == old_size*base) continue;
+            while (new_dim > 0 && (new_size < old_size || shape[new_dim-1] == 1)) {
+                --new_dim;
+                stride[new_dim] = new_size*base;
+                new_size *= shape[new_dim];
+            }
+            if (new_size != old_size) return false;
+            old_size = new_size = 1;
         }
-        return ptr;
+        // what is left are new dimensions of size 1
+        while (new_dim > 0) {
+            if (shape[--new_dim] != 1) return false;
+        }
+        // size 1 dimensions get stride 0, as everywhere else, so they broadcast
+        for (index_t i = 0; i < shape.n_dim(); ++i)
+            if (shape[i] == 1) stride[i] = 0;
+        return true;
     }
 
     Alloc::NonTrivalUniquePtr<TensorImpl>
     TensorImpl::permute(std::initializer_list<index_t> dims) const {
 		CHECK_EQUAL(dims.size(), n_dim(),
-			"Dimension not match (expected dims of %d, but got %zu)",
+			"Dimension not match (expected dims of %zu, but got %zu)",
 			n_dim(), dims.size());
         Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
         ptr = Alloc::unique_construct<TensorImpl>(_storage, _shape);
@@ -195,55 +396,149 @@ namespace st {
         return ptr;
     }
 
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::expand(const Shape& shape) const {
+        CHECK_TRUE(shape.n_dim() >= n_dim(),
+            "The expanded size must have at least %zu dimensions, but got %zu", n_dim(), shape.n_dim());
+        index_t lead = shape.n_dim() - n_dim();
+        IndexArray stride(shape.n_dim());
+        for (index_t i = 0; i < shape.n_dim(); ++i) {
+            if (i < lead || shape[i] == 1) {
+                stride[i] = 0;
+                continue;
+            }
+            index_t old = _shape[i-lead];
+            CHECK_TRUE(old == shape[i] || old == 1,
+                "The expanded size %zu must match the existing size %zu at non-singleton dimension %zu",
+                shape[i], old, i);
+            stride[i] = old == 1 ? 0 : _stride[i-lead];
+        }
+        return Alloc::unique_construct<TensorImpl>(_storage, shape, stride);
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::squeeze() const {
+        std::vector<index_t> shape, stride;
+        for (index_t i = 0; i < n_dim(); ++i) {
+            if (_shape[i] == 1) continue;
+            shape.push_back(_shape[i]);
+            stride.push_back(_stride[i]);
+        }
+        if (shape.empty()) { // tensors keep at least one dimension
+            shape.push_back(1);
+            stride.push_back(0);
+        }
+        return Alloc::unique_construct<TensorImpl>(_storage, Shape(IndexArray(shape)), IndexArray(stride));
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::squeeze(index_t dim) const {
+        CHECK_IN_RANGE(dim, 0, n_dim(),
+            "Dimension out of range (expected to be in range of [0, %zu), but got %zu)",
+            n_dim(), dim);
+        if (_shape[dim] != 1 || n_dim() == 1)
+            return Alloc::unique_construct<TensorImpl>(*this);
+        IndexArray stride(n_dim()-1);
+        for (index_t i = 0; i+1 < n_dim(); ++i)
+            stride[i] = _stride[i < dim ? i : i+1];
+        return Alloc::unique_construct<TensorImpl>(_storage, Shape(_shape, dim), stride);
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::unsqueeze(index_t dim) const {
+        CHECK_IN_RANGE(dim, 0, n_dim()+1,
+            "Dimension out of range (expected to be in range of [0, %zu], but got %zu)",
+            n_dim(), dim);
+        Shape shape(n_dim()+1);
+        IndexArray stride(n_dim()+1);
+        for (index_t i = 0, j = 0; i <= n_dim(); ++i) {
+            if (i == dim) {
+                shape[i] = 1;
+                stride[i] = 0;
+            } else {
+                shape[i] = _shape[j];
+                stride[i] = _stride[j++];
+            }
+        }
+        return Alloc::unique_construct<TensorImpl>(_storage, shape, stride);
+    }
+
     Alloc::NonTrivalUniquePtr<TensorImpl>
     TensorImpl::sum(int idx) const {
         CHECK_IN_RANGE(idx, 0, n_dim(),
-            "Dimension out of range (expected to be in range of [0, %d), but got %d)",
+            "Dimension out of range (expected to be in range of [0, %zu), but got %d)",
             n_dim(), idx);
+        Shape shape(_shape, idx);
         Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
-        ptr = Alloc::unique_construct<TensorImpl>(Shape(_shape, idx));
-        std::vector<index_t> idxs(_shape.n_dim(), 0);
-        std::vector<index_t> new_idxs(_shape.n_dim()-1, 0);
-        index_t cnt = 0;
-        while (cnt < d_size()) {
-            data_t res = 0;
-            for (int i = 0; i < _shape[idx]; ++i) {
-                idxs[idx] = i;
-                res += eval(idxs);
-            }
-            new_idxs.clear();
-            for (int i = 0; i < n_dim(); ++i) {
-                if (i == idx) continue;
-                new_idxs.push_back(idxs[i]);
-            }
-            index_t index = 0;
-            for (index_t i = 0; i < new_idxs.size(); ++i) {
-                index += new_idxs[i] * ptr->_stride[i];
-            }
-            ptr->item(index) = res;
-            for (int i = 0; i < n_dim(); ++i) {
-                if (i == idx) continue;
-                if (idxs[i] + 1 >= _shape[i]) idxs[i] = 0;
-                else {
-                    ++idxs[i];
-                    break;
-                }
-            }
-            cnt += _shape[idx];
-        }
+        ptr = Alloc::unique_construct<TensorImpl>(Storage(shape.d_size(), dtype()), shape);
+        sum(idx, *ptr);
         return ptr;
     }
 
+    void TensorImpl::sum(int idx, TensorImpl& out) const {
+        CHECK_IN_RANGE(idx, 0, n_dim(),
+            "Dimension out of range (expected to be in range of [0, %zu), but got %d)",
+            n_dim(), idx);
+        index_t dim = idx;
+        CHECK_EQUAL(out.n_dim(), n_dim()-1,
+            "Expected a %zuD output for sum over dimension %d, but got %zuD",
+            n_dim()-1, idx, out.n_dim());
+        for (index_t i = 0; i < out.n_dim(); ++i)
+            CHECK_EQUAL(out._shape[i], _shape[i < dim ? i : i+1],
+                "Expected size %zu on dimension %zu of the output, but got %zu",
+                _shape[i < dim ? i : i+1], i, out._shape[i]);
+        // out may be a view of this, so reduce into a temporary first
+        if (overlaps(out, false)) {
+            TensorImpl tmp(Storage(out.d_size(), out.dtype()), out._shape);
+            sum(idx, tmp);
+            out = &tmp;
+            return;
+        }
+        void* res_ptr = out._storage.raw();
+        // the output loops over the other dimensions, with the source's strides
+        IndexArray src_stride(out.n_dim());
+        for (index_t i = 0; i < out.n_dim(); ++i)
+            src_stride[i] = _stride[i < dim ? i : i+1];
+        LoopNest<2> loop = make_loop<2>(out._shape, {&out._stride, &src_stride});
+        index_t cols = loop.cols(), len = _shape[dim], step = _stride[dim];
+        index_t dst_step = loop.stride[0].back(), src_step = loop.stride[1].back();
+        std::vector<data_t> acc(cols);
+        dispatch(dtype(), [&]<typename T>() {
+            const T* data = _storage.data<T>();
+            for_each_row(loop, [&](const auto& offset) {
+                const T* row = data + offset[1];
+                std::fill(acc.begin(), acc.end(), 0);
+                // keep the smaller stride innermost
+                if (std::abs((stride_t)step) < std::abs((stride_t)src_step)) {
+                    for (index_t j = 0; j < cols; ++j)
+                        for (index_t i = 0; i < len; ++i)
+                            acc[j] += to_data(row[j*src_step + i*step]);
+                } else {
+                    for (index_t i = 0; i < len; ++i)
+                        for (index_t j = 0; j < cols; ++j)
+                            acc[j] += to_data(row[j*src_step + i*step]);
+                }
+                for (index_t j = 0; j < cols; ++j)
+                    store(res_ptr, out.dtype(), offset[0] + j*dst_step, acc[j]);
+            });
+        });
+    }
+
     // friend function
     std::ostream& operator<<(std::ostream& out, const TensorImpl& tensor) {
         int max_width = 0;
-        for (int i = 0; i < tensor.d_size(); ++i) {
-            int value = (int)std::abs(tensor.item(i));
-            int dig = value = (int)(std::log10(value))+1;
-            if (tensor.item(i) < 0) ++dig;
-            max_width = std::max(max_width, dig);
-        }
-        int cnt = 0, idx = 0, end_flag = tensor.n_dim();
+        LoopNest<1> loop = make_loop<1>(tensor._shape, {&tensor._stride});
+        for_each_row(loop, [&](const auto& offset) {
+            for (index_t j = 0; j < loop.cols(); ++j) {
+                data_t item = tensor.item(offset[0] + j*loop.stride[0].back());
+                int value = (int)std::abs(item);
+                int dig = value = (int)(std::log10(value))+1;
+                if (item < 0) ++dig;
+                max_width = std::max(max_width, dig);
+            }
+        });
+        index_t cnt = 0, idx = 0;
+        int end_flag = tensor.n_dim();
         std::vector<int> dim_cnt(tensor.n_dim());
         while (cnt < tensor.d_size()) {
             for (int i = 0; i < tensor.n_dim()-end_flag; ++i)
@@ -259,7 +554,7 @@ namespace st {
                     ++dim_cnt[i];
                     break;
                 } else {
-                    idx -= ((int)tensor.size()[i]-1)*tensor.stride()[i];
+                    idx -= (tensor.size()[i]-1)*tensor.stride()[i];
                     dim_cnt[i] = 0;
                     ++end_flag;
                 }
@@ -278,73 +573,66 @@ namespace st {
     }
 
     data_t TensorImpl::sum() const {
-        data_t res = 0;
-        std::vector<index_t> idx(n_dim(), 0);
-        for (int i = 0; i < d_size(); ++i) {
-            int cnt = 0;
-            res += eval(idx);
-            for (int j = 0; j < n_dim(); ++j) {
-                if (idx[j]+1 < size()[j]) {
-                    ++idx[j];
-                    break;
-                } else {
-                    idx[j] = 0;
-                    ++cnt;
-                }
-            }
-            if (cnt == n_dim()) break;
-        }
-        return res;
+        LoopNest<1> loop = make_loop<1>(_shape, {&_stride});
+        index_t cols = loop.cols(), step = loop.stride[0].back();
+        return dispatch(dtype(), [&]<typename T>() {
+            const T* data = _storage.data<T>();
+            data_t res = 0;
+            for_each_row(loop, [&](const auto& offset) {
+                const T* row = data + offset[0];
+                for (index_t j = 0; j < cols; ++j)
+                    res += to_data(row[j*step]);
+            });
+            return res;
+        });
     }
 
     // TensorMaker
-    TensorImpl TensorMaker::ones(const Shape &shape) {
-        TensorImpl tensor(shape);
-        for (int i = 0; i < tensor.d_size(); ++i)
-            tensor.item(i) = 1;
-        return tensor;
+    TensorImpl TensorMaker::empty(const Shape &shape, DType dtype) {
+        return TensorImpl(Storage(shape.d_size(), dtype), shape);
+    }
+
+    TensorImpl TensorMaker::ones(const Shape &shape, DType dtype) {
+        return TensorImpl(Storage(shape.d_size(), 1, dtype), shape);
     }
 
     TensorImpl TensorMaker::ones_like(const TensorImpl &tensor) {
-        return ones(tensor.size());
+        return ones(tensor.size(), tensor.dtype());
     }
 
-    TensorImpl TensorMaker::zeros(const Shape &shape) {
-        TensorImpl tensor(shape);
-        for (int i = 0; i < tensor.d_size(); ++i)
-            tensor.item(i) = 0;
-        return tensor;
+    TensorImpl TensorMaker::zeros(const Shape &shape, DType dtype) {
+        return TensorImpl(shape, dtype);
     }
 
     TensorImpl TensorMaker::zeros_like(const TensorImpl &tensor) {
-        return zeros(tensor.size());
+        return zeros(tensor.size(), tensor.dtype());
     }
 
-    TensorImpl TensorMaker::rand(const Shape &shape) {
+    TensorImpl TensorMaker::rand(const Shape &shape, DType dtype) {
         std::random_device rd;
         std::default_random_engine gen(rd());
         std::uniform_real_distribution<data_t> dis(0, 1);
-        TensorImpl tensor(shape);
-        for (int i = 0; i < tensor.d_size(); ++i)
+        TensorImpl tensor = empty(shape, dtype);
+        for (index_t i = 0; i < tensor.d_size(); ++i)
             tensor.item(i) = dis(gen);
         return tensor;
     }
 
     TensorImpl TensorMaker::rand_like(const TensorImpl &tensor) {
-        return rand(tensor.size());
+        return rand(tensor.size(), tensor.dtype());
     }
 
-    TensorImpl TensorMaker::randn(const Shape &shape) {
+    TensorImpl TensorMaker::randn(const Shape &shape, DType dtype) {
         std::random_device rd;
         std::default_random_engine gen(rd());
         std::normal_distribution<data_t> dis(0, 1);
-        TensorImpl tensor(shape);
-        for (int i = 0; i < tensor.d_size(); ++i)
+        TensorImpl tensor = empty(shape, dtype);
+        for (index_t i = 0; i < tensor.d_size(); ++i)
             tensor.item(i) = dis(gen);
         return tensor;
     }
 
     TensorImpl TensorMaker::randn_like(const TensorImpl &tensor) {
-        return randn(tensor.size());
+        return randn(tensor.size(), tensor.dtype());
     }
 } // st
\ No newline at end of file
@@ -1,5 +1,14 @@
+#include <cstring>
 #include <iostream>
+#include <random>
 #include "tensor.h"
+#include "quantize.h"
+#include "serialize.h"
+#include "npy.h"
+#include "safetensors.h"
+#include "loader.h"
+#include "indexing.h"
+#include "cpu.h"
 #include "gtest/gtest.h"
 
 TEST(tensorConstructorTest, by_storage_and_shape) {
@@ -36,6 +45,13 @@ TEST(tensorConstructorTest, copy_constructor) {
                 EXPECT_EQ(2*((i*2+j)*2+k+1)-1, (B[{i, j, k}]));
 }
 
+TEST(tensorConstructorTest, largeShape) {
+    st::Shape shape({3, 65536, 65536});
+    EXPECT_EQ(3ull << 32, shape.d_size());
+    EXPECT_EQ(1ull << 32, shape.sub_size(1));
+    EXPECT_EQ(1ull << 16, shape.sub_size(1, 2));
+}
+
 TEST(tensorMakerTest, makers) {
     st::Tensor A = st::Tensor::zeros({2, 2, 2});
     st::Tensor B = st::Tensor::rand({2, 2, 2});
@@ -123,6 +139,630 @@ TEST(tensorCalcOperator, matmul) {
     std::cout << C << std::endl;
 }
 
+TEST(tensorCalcOperatorTest, transcendental) {
+    st::Tensor A = st::Tensor::rand({4, 100});
+    st::Tensor B = st::Tensor::rand({100, 4}).transpose(0, 1);
+    st::Tensor C = st::sin(A) + st::cos(B) * st::tan(A);
+    st::Tensor D = st::exp(A) - st::log(B) + st::tanh(-A) * st::sigmoid(B);
+    st::Tensor E = st::tanh(A) * st::log(A) - st::sigmoid(A);
+    for (st::index_t i = 0; i < 4; ++i)
+        for (st::index_t j = 0; j < 100; ++j) {
+            st::data_t a = A[{i, j}], b = B[{i, j}];
+            EXPECT_DOUBLE_EQ(std::sin(a) + std::cos(b) * std::tan(a), (C[{i, j}]));
+            EXPECT_DOUBLE_EQ(std::exp(a) - std::log(b) + std::tanh(-a) / (1 + std::exp(-b)), (D[{i, j}]));
+            EXPECT_DOUBLE_EQ(std::tanh(a) * std::log(a) - 1 / (1 + std::exp(-a)), (E[{i, j}]));
+        }
+}
+
+TEST(tensorCalcOperatorTest, transcendentalFast) {
+    st::Tensor A = st::Tensor::randn({1000});
+    st::vmath::set_precision(st::vmath::Precision::Fast);
+    st::Tensor B = st::sin(A) * st::exp(A);
+    st::vmath::set_precision(st::vmath::Precision::Accurate);
+    for (st::index_t i = 0; i < 1000; ++i)
+        EXPECT_NEAR(std::sin(A[{i}]) * std::exp(A[{i}]), (B[{i}]), 1e-14 * std::exp(A[{i}]));
+}
+
+TEST(tensorCalcOperatorTest, transcendentalUlp) {
+    // the error bounds documented in vmath.h, against long double references
+    auto ulp_error = [](st::data_t got, long double ref) {
+        if (std::isnan(got) || std::isnan(ref)) return std::isnan(got) && std::isnan(ref) ? 0.0 : INFINITY;
+        if (std::isinf(got) || std::isinf((st::data_t)ref)) return got == (st::data_t)ref ? 0.0 : INFINITY;
+        int e;
+        std::frexp((st::data_t)ref, &e);
+        return (st::data_t)(std::fabs(got - ref) / std::ldexp(1.0L, std::max(e-53, -1074)));
+    };
+    using Map = void (*)(const st::data_t*, st::data_t*, st::index_t);
+    struct Range {
+        Map f;
+        long double (*ref)(long double);
+        st::data_t lo, hi; // the range, or of log2|x| for a logarithmic one over both signs
+        bool log_scale;
+        st::data_t accurate, fast; // bounds in ulp, fast < 0 for outside its range
+    };
+    auto sigmoid = [](long double x) { return 1 / (1 + std::exp(-x)); };
+    std::vector<Range> ranges = {
+        {st::vmath::sin, sinl, -1e5, 1e5, false, 1, 2},
+        {st::vmath::sin, sinl, -1074, 1023, true, 1, -1},
+        {st::vmath::cos, cosl, -1e5, 1e5, false, 1, 2},
+        {st::vmath::cos, cosl, -1074, 1023, true, 1, -1},
+        {st::vmath::tan, tanl, -1e5, 1e5, false, 3, 3},
+        {st::vmath::tan, tanl, -1074, 1023, true, 3, -1},
+        {st::vmath::exp, expl, -708, 708, false, 1, 3},
+        {st::vmath::exp, expl, -745, 709.7, false, 1, -1},
+        {st::vmath::log, logl, -1022, 1023, true, 1, 3},
+        {st::vmath::log, logl, -1074, 1023, true, 1, -1},
+        {st::vmath::tanh, tanhl, -354, 354, false, 3, 3},
+        {st::vmath::tanh, tanhl, -1074, 8, true, 3, -1},
+        {st::vmath::sigmoid, sigmoid, -708, 708, false, 3, 3},
+        {st::vmath::sigmoid, sigmoid, -745, 709.7, false, 3, -1},
+    };
+    std::mt19937_64 gen(7);
+    for (bool fast : {false, true}) {
+        st::vmath::set_precision(fast ? st::vmath::Precision::Fast : st::vmath::Precision::Accurate);
+        for (st::index_t r = 0; r < ranges.size(); ++r) {
+            const Range& range = ranges[r];
+            st::data_t bound = fast ? range.fast : range.accurate;
+            if (bound < 0) continue;
+            std::uniform_real_distribution<st::data_t> dist(range.lo, range.hi);
+            std::vector<st::data_t> x(1 << 15), y(x.size());
+            for (st::index_t i = 0; i < x.size(); ++i) {
+                x[i] = dist(gen);
+                if (range.log_scale) x[i] = (range.ref == logl || i % 2 ? 1 : -1) * std::exp2(x[i]);
+            }
+            range.f(x.data(), y.data(), x.size());
+            st::data_t worst = 0;
+            for (st::index_t i = 0; i < x.size(); ++i)
+                worst = std::max(worst, ulp_error(y[i], range.ref(x[i])));
+            EXPECT_LT(worst, bound) << "range " << r << (fast ? ", fast" : "");
+        }
+    }
+    st::vmath::set_precision(st::vmath::Precision::Accurate);
+}
+
+TEST(tensorCalcOperatorTest, compoundAssign) {
+    st::Tensor A = st::Tensor::rand({3, 3});
+    st::Tensor B = st::Tensor::rand({3, 3});
+    st::Tensor C = 1 * A;
+    C += B;
+    C *= 2;
+    C -= B * A;
+    C /= st::exp(B);
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 3; ++j) {
+            st::data_t a = A[{i, j}], b = B[{i, j}];
+            EXPECT_DOUBLE_EQ(((a + b) * 2 - b * a) / std::exp(b), (C[{i, j}]));
+        }
+    // the source reads elements of the destination written before them
+    st::Tensor D = st::Tensor::rand({3, 3});
+    st::Tensor E = 1 * D;
+    D += D.transpose(0, 1);
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            EXPECT_DOUBLE_EQ((E[{i, j}] + E[{j, i}]), (D[{i, j}]));
+    // strided destination
+    st::Tensor F = st::Tensor::ones({2, 4});
+    st::Tensor G = F.slice(1, 3, 1);
+    G += 1;
+    G *= G;
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 4; ++j)
+            EXPECT_EQ((j == 1 || j == 2) ? 4 : 1, (F[{i, j}]));
+}
+
+TEST(tensorCalcOperatorTest, aliasedAssign) {
+    st::Tensor A = st::Tensor::rand({3, 3});
+    st::Tensor B = st::Tensor::rand({3, 3});
+    st::Tensor C = 1 * A;
+    A = A.transpose(0, 1) + B;
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            EXPECT_EQ((C[{j, i}] + B[{i, j}]), (A[{i, j}]));
+    // rows shifted down and up within the same storage
+    st::Tensor D = st::Tensor::rand({4, 3});
+    st::Tensor E = 1 * D;
+    st::Tensor lower = D.slice(1, 4, 0), upper = D.slice(0, 3, 0);
+    lower = 1 * upper;
+    for (st::index_t i = 1; i < 4; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            EXPECT_EQ((E[{i-1, j}]), (D[{i, j}]));
+    upper = st::exp(lower);
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            EXPECT_DOUBLE_EQ(std::exp(E[{i, j}]), (D[{i, j}]));
+}
+
+TEST(tensorCalcOperatorTest, evalInto) {
+    st::Tensor A = st::Tensor::rand({3, 4});
+    st::Tensor B = st::Tensor::rand({4, 2});
+    st::Tensor out = st::Tensor::empty({3, 2});
+    st::eval_into(out, st::matmul(A, B));
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 2; ++j) {
+            st::data_t res = 0;
+            for (st::index_t k = 0; k < 4; ++k)
+                res += A[{i, k}] * B[{k, j}];
+            EXPECT_DOUBLE_EQ(res, (out[{i, j}]));
+        }
+    // into a view of a bigger buffer
+    st::Tensor D = st::Tensor::zeros({5, 4});
+    st::Tensor rows = D.slice(1, 4, 0);
+    st::eval_into(rows, 2 * A);
+    for (st::index_t j = 0; j < 4; ++j) {
+        EXPECT_EQ(0, (D[{0, j}]));
+        EXPECT_EQ(0, (D[{4, j}]));
+        for (st::index_t i = 0; i < 3; ++i)
+            EXPECT_EQ((A[{i, j}] * 2), (D[{i+1, j}]));
+    }
+    st::Tensor col = st::Tensor::empty({4});
+    A.sum(0, col);
+    st::Tensor S = A.sum(0);
+    for (st::index_t j = 0; j < 4; ++j)
+        EXPECT_DOUBLE_EQ((S[{j}]), (col[{j}]));
+    EXPECT_THROW(st::eval_into(out, st::sin(A)), st::err::Error);
+    EXPECT_THROW(A.sum(1, col), st::err::Error);
+}
+
+TEST(tensorOperatorTest, copyOnWrite) {
+    st::Tensor A({1, 2, 3, 4, 5, 6}, {2, 3});
+    st::Tensor B = A.clone();
+    st::Tensor row = A.slice(1);
+    st::index_t version = A.version();
+    row += 10;
+    EXPECT_LT(version, A.version());
+    for (st::index_t j = 0; j < 3; ++j) {
+        EXPECT_EQ(j+4, (B[{1, j}]));
+        EXPECT_EQ(j+14, (A[{1, j}]));
+    }
+    B[{0, 0}] = -1;
+    EXPECT_EQ(1, (A[{0, 0}]));
+    // slice of a slice keeps the absolute offset
+    st::Tensor C = A.slice(1, 3, 1).slice(1, 2, 1);
+    EXPECT_EQ(16, (C[{1, 0}]));
+    // copy construction and copy assignment both alias, only clone() copies
+    st::Tensor D = st::Tensor::zeros({3});
+    D = C;
+    st::Tensor E(C);
+    st::Tensor F = C.clone();
+    C[{1, 0}] = 7;
+    EXPECT_EQ(7, (D[{1, 0}]));
+    EXPECT_EQ(7, (E[{1, 0}]));
+    EXPECT_EQ(16, (F[{1, 0}]));
+    D[{0, 0}] = 8;
+    EXPECT_EQ(8, (E[{0, 0}]));
+    // an element reference outlives the temporary view it came from
+    auto ref = A.slice(0)[{0, 1}];
+    EXPECT_EQ(2, ref);
+    ref = 20;
+    EXPECT_EQ(20, (A[{0, 1}]));
+}
+
+TEST(tensorConstructorTest, fromBlob) {
+    std::vector<st::data_t> buffer = {1, 2, 3, 4, 5, 6};
+    int released = 0;
+    {
+        st::Tensor A = st::Tensor::from_blob(buffer.data(), {2, 3}, [&](void* ptr) {
+            EXPECT_EQ(buffer.data(), ptr);
+            ++released;
+        });
+        st::Tensor row = A.slice(1);
+        buffer[4] = 50;
+        EXPECT_EQ(50, (A[{1, 1}]));
+        A[{0, 2}] = 30;
+        EXPECT_EQ(30, buffer[2]);
+        {
+            st::Tensor B = A.transpose(0, 1);
+            A = st::Tensor::zeros({2, 3});
+        }
+        EXPECT_EQ(0, released);
+        EXPECT_EQ(50, (row[{0, 1}]));
+    }
+    EXPECT_EQ(1, released);
+
+    // strided int32 data: every other column of a 2x4 buffer
+    int32_t ints[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    st::Tensor C = st::Tensor::from_blob(ints, {2, 2}, {4, 2}, {}, st::DType::Int32);
+    EXPECT_EQ(st::DType::Int32, C.dtype());
+    EXPECT_EQ(7, (C[{1, 1}]));
+    EXPECT_EQ(1+3+5+7, C.sum());
+    EXPECT_THROW(st::Tensor::from_blob(ints, {2, 2}, {4, static_cast<st::index_t>(-2)}, {}, st::DType::Int32), st::err::Error);
+    st::Tensor none = st::Tensor::from_blob(ints, {0, 4}, {8, 1}, {}, st::DType::Int32);
+    EXPECT_EQ(0, std::as_const(*none.ptr()).storage().size_);
+
+    // a clone of a blob is a separate buffer, and writes to either side stay there
+    st::Tensor D = st::Tensor::from_blob(buffer.data(), {6});
+    st::Tensor E = D.clone();
+    D[{0}] = 10;
+    E[{1}] = 20;
+    EXPECT_EQ(10, buffer[0]);
+    EXPECT_EQ(2, buffer[1]);
+    EXPECT_EQ(1, (E[{0}]));
+    EXPECT_EQ(20, (E[{1}]));
+}
+
+TEST(tensorConstructorTest, mapFile) {
+    std::string path = testing::TempDir() + "st_map_file.bin";
+    std::vector<float> values = {-1, 0, 1, 2, 3, 4, 5, 6, 7};
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    ASSERT_NE(nullptr, file);
+    std::fwrite(values.data(), sizeof(float), values.size(), file);
+    std::fclose(file);
+
+    // skip the first float, map a 2x4 float32 tensor
+    st::Tensor A = st::Tensor::map_file(path, {2, 4}, st::DType::Float32, st::MapMode::ReadOnly, sizeof(float));
+    EXPECT_EQ(6, (A[{1, 2}]));
+    st::Tensor row = A.slice(1);
+    EXPECT_EQ(std::as_const(*A.ptr()).storage().data<float>()+4, std::as_const(*row.ptr()).storage().data<float>());
+    // writes to the read-only mapping throw; a clone copies the data out on its first write
+    EXPECT_THROW((row[{0, 0}] = 40), st::err::Error);
+    st::Tensor R = A.clone();
+    R[{1, 0}] = 40;
+    EXPECT_EQ(40, (R[{1, 0}]));
+    EXPECT_EQ(4, (A[{1, 0}]));
+    // also once the mapping itself is gone
+    st::Tensor S = st::Tensor::map_file(path, {9}, st::DType::Float32).clone();
+    S[{0}] = 10;
+    EXPECT_EQ(10, (S[{0}]));
+    st::Tensor B = st::Tensor::map_file(path, {9}, st::DType::Float32, st::MapMode::CopyOnWrite);
+    EXPECT_EQ(4, (B[{5}]));
+    B[{5}] = 50;
+    EXPECT_EQ(50, (B[{5}]));
+    st::Tensor C = st::Tensor::map_file(path, {9}, st::DType::Float32);
+    EXPECT_EQ(4, (C[{5}]));
+
+    EXPECT_THROW(st::Tensor::map_file(path, {10}, st::DType::Float32), st::err::Error);
+    EXPECT_THROW(st::Tensor::map_file(path + ".missing", {1}), st::err::Error);
+    std::remove(path.c_str());
+}
+
+TEST(tensorConstructorTest, saveLoad) {
+    std::string path = testing::TempDir() + "st_save_load.st";
+    st::Tensor A = st::Tensor::randn({3, 5});
+    st::Tensor B = st::Tensor::rand({4, 1, 2}, st::DType::Float16);
+    st::Tensor I({1, 2, 3, 4, 5, 6}, {2, 3});
+    st::save(path, {{"a", A}, {"b", B}, {"i_t", I.to(st::DType::Int32).transpose(0, 1)}});
+
+    auto tensors = st::load(path);
+    ASSERT_EQ(3, tensors.size());
+    const st::Tensor& a = tensors.at("a");
+    EXPECT_EQ(st::DType::Float64, a.dtype());
+    EXPECT_EQ(A.size(), a.size());
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 5; ++j)
+            EXPECT_EQ((A[{i, j}]), (a[{i, j}]));
+    const st::Tensor& b = tensors.at("b");
+    EXPECT_EQ(st::DType::Float16, b.dtype());
+    EXPECT_EQ((B[{3, 0, 1}]), (b[{3, 0, 1}]));
+    // payloads are 64-byte aligned
+    for (auto& [name, tensor] : tensors)
+        EXPECT_EQ(0, (uintptr_t)std::as_const(*tensor.ptr()).storage().raw() % 64) << name;
+    const st::Tensor& i_t = tensors.at("i_t");
+    EXPECT_EQ(st::DType::Int32, i_t.dtype());
+    EXPECT_EQ(st::Shape({3, 2}), i_t.size());
+    EXPECT_EQ(6, (i_t[{2, 1}]));
+    EXPECT_EQ(2, (i_t[{1, 0}]));
+
+    EXPECT_THROW((void)st::load(path + ".missing"), st::err::Error);
+
+    // a stride of "a" reaching past its payload
+    std::FILE* file = std::fopen(path.c_str(), "r+b");
+    ASSERT_NE(nullptr, file);
+    uint64_t stride = 6;
+    std::fseek(file, 8 + 4 + 4 + 4 + 1 + 1 + 1 + 2*8, SEEK_SET);
+    std::fwrite(&stride, sizeof(stride), 1, file);
+    std::fclose(file);
+    EXPECT_THROW((void)st::load(path), st::err::Error);
+    std::remove(path.c_str());
+}
+
+TEST(tensorConstructorTest, npy) {
+    std::string path = testing::TempDir() + "st_npy.npy";
+    st::Tensor A = st::Tensor::randn({3, 4}, st::DType::Float32);
+    st::save_npy(path, A.transpose(0, 1));
+    st::Tensor a = st::load_npy(path);
+    EXPECT_EQ(st::DType::Float32, a.dtype());
+    EXPECT_EQ(st::Shape({4, 3}), a.size());
+    EXPECT_EQ((A[{2, 1}]), (a[{1, 2}]));
+    EXPECT_EQ(0, (uintptr_t)std::as_const(*a.ptr()).storage().raw() % 64);
+
+    // a Fortran ordered int64 array as NumPy writes it, and with a payload
+    // offset int64 is not aligned to, which is read rather than mapped
+    for (std::size_t payload : {128, 131}) {
+        std::string header = "{'descr': '<i8', 'fortran_order': True, 'shape': (2, 3), }";
+        header.append(payload - 10 - header.size() - 1, ' ');
+        header += '\n';
+        int64_t values[] = {1, 4, 2, 5, 3, 6};
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        ASSERT_NE(nullptr, file);
+        std::fwrite("\x93NUMPY\x01\x00", 1, 8, file);
+        uint16_t header_len = header.size();
+        std::fwrite(&header_len, sizeof(header_len), 1, file);
+        std::fwrite(header.data(), 1, header.size(), file);
+        std::fwrite(values, sizeof(int64_t), 6, file);
+        std::fclose(file);
+        st::Tensor f = st::load_npy(path);
+        EXPECT_EQ(st::DType::Int64, f.dtype());
+        EXPECT_EQ(0, (uintptr_t)std::as_const(*f.ptr()).storage().raw() % sizeof(int64_t));
+        for (st::index_t i = 0; i < 2; ++i)
+            for (st::index_t j = 0; j < 3; ++j)
+                EXPECT_EQ(i*3+j+1, (f[{i, j}]));
+    }
+
+    std::string npz = testing::TempDir() + "st_npz.npz";
+    st::save_npz(npz, {{"x", A}, {"y", st::Tensor({1, 2, 3}, {3}).to(st::DType::UInt8)}});
+    auto arrays = st::load_npz(npz);
+    ASSERT_EQ(2, arrays.size());
+    for (auto& [name, array] : arrays)
+        EXPECT_EQ(0, (uintptr_t)std::as_const(*array.ptr()).storage().raw() % 64) << name;
+    EXPECT_EQ((A[{1, 3}]), (arrays.at("x")[{1, 3}]));
+    EXPECT_EQ(st::DType::UInt8, arrays.at("y").dtype());
+    EXPECT_EQ(3, (arrays.at("y")[{2}]));
+    EXPECT_THROW((void)st::load_npy(npz), st::err::Error);
+    std::remove(path.c_str());
+    std::remove(npz.c_str());
+}
+
+TEST(tensorConstructorTest, safetensors) {
+    std::string path = testing::TempDir() + "st_weights.safetensors";
+    std::string header = R"({"__metadata__": {"format": "pt"},
+        "bias": {"dtype": "F32", "shape": [3], "data_offsets": [24, 36]},
+        "weight": {"dtype": "F64", "shape": [1, 3], "data_offsets": [0, 24]},
+        "mask": {"dtype": "BOOL", "shape": [2], "data_offsets": [36, 38]},
+        "level": {"dtype": "U8", "shape": [1], "data_offsets": [38, 39]},
+        "scale": {"dtype": "F32", "shape": [1], "data_offsets": [39, 43]}})";
+    header.append((8 - header.size() % 8) % 8, ' ');
+    double weight[] = {0.5, -1.5, 2.5};
+    float bias[] = {1, 2, 3};
+    uint64_t header_size = header.size();
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    ASSERT_NE(nullptr, file);
+    std::fwrite(&header_size, sizeof(header_size), 1, file);
+    std::fwrite(header.data(), 1, header.size(), file);
+    std::fwrite(weight, sizeof(double), 3, file);
+    std::fwrite(bias, sizeof(float), 3, file);
+    std::fwrite("\x01\x00\x07", 1, 3, file);
+    std::fwrite(bias, sizeof(float), 1, file);
+    std::fclose(file);
+
+    st::SafeTensors weights(path);
+    EXPECT_EQ(std::vector<std::string>({"bias", "level", "mask", "scale", "weight"}), weights.names());
+    EXPECT_EQ("pt", weights.metadata().at("format"));
+    st::Tensor w = weights.get("weight");
+    EXPECT_EQ(st::Shape({1, 3}), w.size());
+    EXPECT_EQ(-1.5, (w[{0, 1}]));
+    EXPECT_EQ(0, w.version()); // reading did not copy the mapping out
+    st::Tensor b = weights.get("bias");
+    EXPECT_EQ(st::DType::Float32, b.dtype());
+    EXPECT_EQ(3, (b[{2}]));
+    EXPECT_EQ(w.ptr(), weights.get("weight").ptr());
+    EXPECT_THROW((w[{0, 0}] = 1), st::err::Error);
+    EXPECT_EQ(7, (weights.get("level")[{0}]));
+    // scale is misaligned in the file, so it is read into memory instead of mapped
+    st::Tensor scale = weights.get("scale");
+    EXPECT_EQ(1, (scale[{0}]));
+    scale[{0}] = 4;
+    EXPECT_EQ(4, (scale[{0}]));
+    EXPECT_THROW((void)weights.get("mask"), st::err::Error);
+    EXPECT_THROW((void)weights.get("missing"), st::err::Error);
+    std::remove(path.c_str());
+}
+
+TEST(tensorConstructorTest, batchLoader) {
+    std::string path = testing::TempDir() + "st_loader.csv";
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    ASSERT_NE(nullptr, file);
+    std::fputs("x,y,label\n", file);
+    for (int i = 0; i < 7; ++i)
+        std::fprintf(file, "%d.5, %d,%de-1\r\n", i, -i, i);
+    std::fclose(file);
+
+    st::BatchLoader csv(path, st::CsvFormat{',', 1, st::DType::Float32}, 3, 2);
+    EXPECT_EQ(3, csv.n_fields());
+    st::index_t row = 0;
+    while (auto batch = csv.next()) {
+        EXPECT_EQ(st::DType::Float32, batch->dtype());
+        EXPECT_EQ(row < 6 ? 3 : 1, batch->size(0));
+        for (st::index_t i = 0; i < batch->size(0); ++i, ++row) {
+            EXPECT_EQ(row + 0.5, ((*batch)[{i, 0}]));
+            EXPECT_EQ(-(st::data_t)row, ((*batch)[{i, 1}]));
+            EXPECT_FLOAT_EQ(row * 0.1, ((*batch)[{i, 2}]));
+        }
+    }
+    EXPECT_EQ(7, row);
+
+    file = std::fopen(path.c_str(), "w");
+    std::fputs("1,2\n3,x\n", file);
+    std::fclose(file);
+    st::BatchLoader bad(path, st::CsvFormat{}, 1);
+    EXPECT_TRUE(bad.next().has_value());
+    EXPECT_THROW((void)bad.next(), st::err::Error);
+
+    // a long malformed line is quoted only in part
+    file = std::fopen(path.c_str(), "w");
+    std::fprintf(file, "1,%s\n", std::string(2000, 'x').c_str());
+    std::fclose(file);
+    st::BatchLoader long_line(path, st::CsvFormat{}, 1);
+    try {
+        (void)long_line.next();
+        ADD_FAILURE() << "expected a parse error";
+    } catch (const st::err::Error& error) {
+        EXPECT_NE(nullptr, std::strstr(error.what(), "line 1 of"));
+    }
+
+    // a header and no rows reads nothing
+    file = std::fopen(path.c_str(), "w");
+    std::fputs("a,b,c\n", file);
+    std::fclose(file);
+    st::BatchLoader header_only(path, st::CsvFormat{',', 1}, 2);
+    EXPECT_EQ(0, header_only.n_fields());
+    EXPECT_FALSE(header_only.next().has_value());
+
+    std::vector<int32_t> records(2*5);
+    for (int i = 0; i < 10; ++i) records[i] = i;
+    file = std::fopen(path.c_str(), "wb");
+    std::fwrite(records.data(), sizeof(int32_t), records.size(), file);
+    std::fclose(file);
+    st::BatchLoader binary(path, st::BinaryFormat{2, st::DType::Int32}, 4);
+    st::Tensor first = *binary.next();
+    EXPECT_EQ(st::Shape({4, 2}), first.size());
+    EXPECT_EQ(7, (first[{3, 1}]));
+    st::Tensor last = *binary.next();
+    EXPECT_EQ(st::Shape({1, 2}), last.size());
+    EXPECT_EQ(8, (last[{0, 0}]));
+    EXPECT_FALSE(binary.next().has_value());
+    std::remove(path.c_str());
+}
+
+TEST(tensorCalcOperatorTest, dtypes) {
+    st::Tensor A = st::Tensor::rand({3, 4}, st::DType::Float32);
+    st::Tensor I({3, 4}, st::DType::Int32);
+    st::Tensor L = st::Tensor::ones({4}, st::DType::Int64);
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 4; ++j)
+            I[{i, j}] = i * 4 + j;
+    EXPECT_EQ(st::DType::Float32, (A + I).self().dtype());
+    EXPECT_EQ(st::DType::Int64, (I + L).self().dtype());
+    EXPECT_EQ(st::DType::Float64, (I / L).self().dtype());
+    EXPECT_EQ(st::DType::Float32, (2 * A).self().dtype());
+    EXPECT_EQ(st::DType::Float32, st::exp(A).self().dtype());
+    EXPECT_EQ(st::DType::Float64, st::exp(I).self().dtype());
+    st::Tensor B = A * I + L;
+    st::Tensor C = I.transpose(0, 1).to(st::DType::Float64);
+    st::Tensor D = I * L;
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 4; ++j) {
+            EXPECT_EQ((float)((st::data_t)A[{i, j}] * (i * 4 + j) + 1), (B[{i, j}]));
+            EXPECT_EQ(i * 4 + j, (C[{j, i}]));
+            EXPECT_EQ(i * 4 + j, (D[{i, j}]));
+        }
+    // integer stores truncate
+    I[{0, 0}] = 2.7;
+    EXPECT_EQ(2, (I[{0, 0}]));
+    st::Tensor S = I.sum(1);
+    EXPECT_EQ(st::DType::Int32, S.dtype());
+    EXPECT_EQ(2 + 1 + 2 + 3, (S[{0}]));
+
+    // int64 is evaluated exactly up to 2^53 and rejected beyond it
+    std::vector<int64_t> big = {(int64_t(1) << 52) + 1, (int64_t(1) << 51) + 1, (int64_t(1) << 53) + 1};
+    st::Tensor E = st::Tensor::from_blob(big.data(), {3}, {}, st::DType::Int64);
+    st::Tensor F = E.slice(0, 1, 0) + E.slice(1, 2, 0);
+    EXPECT_EQ((int64_t(3) << 51) + 2, F.values<int64_t>()[0]);
+    EXPECT_THROW(st::Tensor(E + E), st::err::Error);
+    EXPECT_THROW((void)E.sum(), st::err::Error);
+    EXPECT_THROW(F += F, st::err::Error);
+    EXPECT_EQ((int64_t(1) << 53) + 1, E.clone().values<int64_t>()[2]);
+}
+
+TEST(tensorCalcOperatorTest, halfTypes) {
+    EXPECT_EQ(0x3555, st::float16(1.0f / 3).bits);
+    EXPECT_EQ(0x7bff, st::float16(65504.0f).bits);
+    EXPECT_EQ(0x7c00, st::float16(65520.0f).bits);
+    EXPECT_EQ(0x0001, st::float16(std::ldexp(1.0f, -24)).bits);
+    EXPECT_EQ(std::ldexp(1.0f, -24), (float)st::float16(std::ldexp(1.0f, -24)));
+    EXPECT_TRUE(std::isnan((float)st::float16(NAN)));
+    EXPECT_EQ(0x3eab, st::bfloat16(1.0f / 3).bits);
+    EXPECT_TRUE(std::isnan((float)st::bfloat16(NAN)));
+
+    st::Tensor A = st::Tensor::rand({3, 300});
+    st::Tensor H = A.to(st::DType::Float16);
+    st::Tensor BF = A.to(st::DType::BFloat16);
+    EXPECT_EQ(st::DType::Float16, (0.1 * H).self().dtype());
+    EXPECT_EQ(st::DType::Float32, (H + BF).self().dtype());
+    st::Tensor B = 0.1 * H;
+    st::Tensor C = H - BF;
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 300; ++j) {
+            st::data_t a = A[{i, j}];
+            EXPECT_EQ((float)st::float16((float)a), (H[{i, j}]));
+            EXPECT_EQ((float)st::bfloat16((float)a), (BF[{i, j}]));
+            EXPECT_EQ((float)st::float16((float)(0.1 * H[{i, j}])), (B[{i, j}]));
+            EXPECT_NEAR(0, (C[{i, j}]), 1.0 / 128);
+        }
+    // accumulation does not happen in 16 bits (it would stop at 2048)
+    st::Tensor ones = st::Tensor::ones({4096, 1}, st::DType::Float16);
+    EXPECT_EQ(4096, ones.sum());
+    EXPECT_EQ(4096, (ones.sum(0)[{0}]));
+}
+
+TEST(tensorCalcOperatorTest, quantized) {
+    st::Tensor X = st::Tensor::randn({5, 150});
+    st::Tensor W = st::Tensor::randn({150, 3});
+    st::QTensor qx = st::quantize(X, 0.03, 128);
+    std::vector<st::data_t> scale = {0.02, 0.025, 0.03};
+    std::vector<int32_t> zero_point = {0, -3, 5};
+    st::QTensor qw = st::quantize_per_channel(W, scale, zero_point, 1);
+    EXPECT_EQ(st::DType::UInt8, qx.dtype());
+    EXPECT_EQ(st::DType::Int8, qw.dtype());
+    st::Tensor dx = st::dequantize(qx, st::DType::Float64);
+    for (st::index_t i = 0; i < 5; ++i)
+        for (st::index_t k = 0; k < 150; ++k)
+            if (std::abs(X[{i, k}]) < 3.8) {
+                EXPECT_NEAR((X[{i, k}]), (dx[{i, k}]), 0.015 + 1e-12);
+            }
+    // the integer product matches the float product of the dequantized operands
+    st::Tensor Y = st::matmul(qx, qw);
+    st::Tensor dw = st::dequantize(qw, st::DType::Float64);
+    st::Tensor ref = st::matmul(dx, dw);
+    EXPECT_EQ(st::DType::Float32, Y.dtype());
+    for (st::index_t i = 0; i < 5; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            EXPECT_FLOAT_EQ((ref[{i, j}]), (Y[{i, j}]));
+    // int8 lhs, uint8 rhs given transposed
+    st::QTensor qa = st::quantize(X, 0.03, -7, st::DType::Int8);
+    st::QTensor qb(st::quantize(W.transpose(0, 1), 0.02, 120).data().transpose(0, 1), {0.02}, {120});
+    st::Tensor Z = st::matmul(qa, qb, st::DType::Float64);
+    st::Tensor ref2 = st::matmul(st::dequantize(qa, st::DType::Float64), st::dequantize(qb, st::DType::Float64));
+    for (st::index_t i = 0; i < 5; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            EXPECT_NEAR((ref2[{i, j}]), (Z[{i, j}]), 1e-9);
+    // 255 * -128 summed over K = 70000 overflows int32 before the zero points are taken out
+    st::QTensor qm = st::quantize(st::Tensor::ones({1, 70000}), 1.0 / 255, 0);
+    st::QTensor qz = st::quantize(st::Tensor::zeros({70000, 1}), 1, -128, st::DType::Int8);
+    EXPECT_EQ(0, (st::matmul(qm, qz, st::DType::Float64)[{0, 0}]));
+    EXPECT_THROW((void)st::quantize(X, 0.1, 300), st::err::Error);
+    EXPECT_THROW((void)st::matmul(qw, qx), st::err::Error);
+}
+
+TEST(tensorCalcOperatorTest, isaDispatch) {
+    // every instruction set the CPU has gives the same bits as the portable code
+    using st::cpu::Isa;
+    std::vector<st::data_t> x(203);
+    for (st::index_t i = 0; i < x.size(); ++i) x[i] = (i % 2 ? -1 : 1) * std::ldexp(1.0 + i, (int)i % 40 - 10);
+    x[7] = NAN, x[8] = INFINITY, x[9] = 1e300, x[10] = -0.0;
+    st::Tensor A = st::Tensor::randn({5, 203});
+    st::QTensor qa = st::quantize(A, 0.03, 128);
+    st::QTensor qw = st::quantize(st::Tensor::randn({203, 7}), 0.02, 0, st::DType::Int8);
+    auto run = [&](Isa isa) {
+        st::cpu::set_max_isa(isa);
+        std::vector<st::data_t> res;
+        for (auto precision : {st::vmath::Precision::Accurate, st::vmath::Precision::Fast}) {
+            st::vmath::set_precision(precision);
+            using Map = void (*)(const st::data_t*, st::data_t*, st::index_t);
+            for (Map f : std::initializer_list<Map>{st::vmath::sin, st::vmath::cos, st::vmath::tan, st::vmath::exp,
+                                                    st::vmath::log, st::vmath::tanh, st::vmath::sigmoid}) {
+                std::vector<st::data_t> y(x.size());
+                f(x.data(), y.data(), x.size());
+                res.insert(res.end(), y.begin(), y.end());
+            }
+        }
+        st::vmath::set_precision(st::vmath::Precision::Accurate);
+        st::Tensor H = A.to(st::DType::Float16).to(st::DType::Float32);
+        st::Tensor Y = st::matmul(qa, qw);
+        for (st::index_t i = 0; i < 5; ++i) {
+            for (st::index_t j = 0; j < 203; ++j) res.push_back(H[{i, j}]);
+            for (st::index_t j = 0; j < 7; ++j) res.push_back(Y[{i, j}]);
+        }
+        return res;
+    };
+    std::vector<st::data_t> ref = run(Isa::Baseline);
+    for (Isa isa : {Isa::AVX2, Isa::AVX512, Isa::AVX512VNNI}) {
+        std::vector<st::data_t> res = run(isa);
+        for (st::index_t i = 0; i < ref.size(); ++i)
+            EXPECT_TRUE(std::memcmp(&ref[i], &res[i], sizeof(st::data_t)) == 0) << "isa " << (int)isa << ", value " << i;
+    }
+    st::cpu::set_max_isa(Isa::AVX512VNNI);
+}
+
 TEST(tensorOperatorTest, slice_piece) {
     st::Tensor A = st::Tensor::rand({2, 3, 3});
     st::Tensor B = A.slice(2, 2);
@@ -151,6 +791,41 @@ TEST(tensorOperatorTest, slice_cube) {
     std::cout << A << std::endl;
     std::cout << B << std::endl;
 }
+TEST(tensorOperatorTest, slice_step) {
+    st::Tensor A = st::Tensor::rand({4, 5, 6});
+    st::Tensor B = A.slice(std::nullopt, std::nullopt, -1, 1);
+    st::Tensor C = A.slice(-5, 6, 2, 2);
+    st::Tensor D = A.slice({{}, {-1, 0, -2}, {std::nullopt, 1, -3}});
+    EXPECT_EQ(5, B.size(1));
+    EXPECT_EQ(3, C.size(2));
+    EXPECT_EQ(2, D.size(1));
+    EXPECT_EQ(2, D.size(2));
+    for (st::index_t i = 0; i < 4; ++i)
+        for (st::index_t j = 0; j < 5; ++j)
+            for (st::index_t k = 0; k < 6; ++k) {
+                EXPECT_EQ((A[{i, 4-j, k}]), (B[{i, j, k}]));
+                if (k < 3) { EXPECT_EQ((A[{i, j, 1+2*k}]), (C[{i, j, k}])); }
+                if (j < 2 && k < 2) { EXPECT_EQ((A[{i, 4-2*j, 5-3*k}]), (D[{i, j, k}])); }
+            }
+
+    // reversed views compose, copy and evaluate like any other
+    st::Tensor E = B.slice(std::nullopt, std::nullopt, -1, 1);
+    EXPECT_EQ((A[{3, 2, 1}]), (E[{3, 2, 1}]));
+    st::Tensor F = B.contiguous();
+    st::Tensor G = B + A;
+    for (st::index_t j = 0; j < 5; ++j) {
+        EXPECT_EQ((B[{1, j, 2}]), (F[{1, j, 2}]));
+        EXPECT_EQ((B[{1, j, 2}]) + (A[{1, j, 2}]), (G[{1, j, 2}]));
+    }
+    st::Tensor H = A.clone();
+    st::Tensor reversed = H.slice(std::nullopt, std::nullopt, -1, 0);
+    st::eval_into(reversed, A + A);
+    EXPECT_EQ((A[{0, 1, 2}]) * 2, (H[{3, 1, 2}]));
+
+    EXPECT_THROW((void)A.slice(0, 4, 0, 0), st::err::Error);
+    EXPECT_THROW((void)A.slice(3, 1, 1, 0), st::err::Error);
+    EXPECT_THROW((void)A.slice({{}, {}, {}, {}}), st::err::Error);
+}
 
 TEST(tensorOperatorTest, transpose) {
     st::Tensor A = st::Tensor::rand({2, 3, 4});
@@ -177,6 +852,27 @@ TEST(tensorOperatorTest, reshape) {
             EXPECT_EQ((A[{i, j / 4, j % 4}]), (B[{i, j}]));
     std::cout << A << std::endl;
     std::cout << B << std::endl;
+
+    // splitting and merging dimensions of a strided tensor needs no copy
+    st::Tensor C = st::Tensor::rand({4, 6, 5}).slice(1, 3, 0).transpose(1, 2);
+    st::Tensor D = C.reshape({2, 5, 2, 3});
+    EXPECT_EQ(C.ptr()->storage().raw(), D.ptr()->storage().raw());
+    st::Tensor E = C.slice(0, 1, 0).reshape({5, 1, 6});
+    EXPECT_EQ(C.ptr()->storage().raw(), E.ptr()->storage().raw());
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 5; ++j)
+            for (st::index_t k = 0; k < 6; ++k) {
+                EXPECT_EQ((C[{i, j, k}]), (D[{i, j, k / 3, k % 3}]));
+                if (i == 0) { EXPECT_EQ((C[{i, j, k}]), (E[{j, 0, k}])); }
+            }
+
+    // merging across the transposed dimensions has to copy
+    EXPECT_THROW((void)C.view({10, 6}), st::err::Error);
+    st::Tensor F = C.reshape({10, 6});
+    EXPECT_NE(C.ptr()->storage().raw(), F.ptr()->storage().raw());
+    for (st::index_t i = 0; i < 60; ++i)
+        EXPECT_EQ((C[{i / 30, i / 6 % 5, i % 6}]), (F[{i / 6, i % 6}]));
+    EXPECT_THROW((void)C.reshape({7, 8}), st::err::Error);
 }
 
 TEST(tensorOperatorTest, permute) {
@@ -193,6 +889,180 @@ TEST(tensorOperatorTest, permute) {
     std::cout << A << std::endl;
     std::cout << B << std::endl;
 }
+TEST(tensorOperatorTest, contiguous) {
+    st::Tensor A = st::Tensor::rand({3, 5, 70});
+    st::Tensor same = A.contiguous();
+    EXPECT_EQ(A.ptr(), same.ptr());
+
+    auto check = [](const st::Tensor& src) {
+        st::Tensor res = src.contiguous();
+        EXPECT_TRUE(res.ptr()->is_contiguous());
+        EXPECT_EQ(src.size(), res.size());
+        EXPECT_EQ(src.dtype(), res.dtype());
+        for (st::index_t i = 0; i < src.d_size(); ++i) {
+            st::index_t idx[3];
+            for (st::index_t d = 3, rest = i; d-- > 0; rest /= src.size(d))
+                idx[d] = rest % src.size(d);
+            EXPECT_EQ((src[{idx[0], idx[1], idx[2]}]), std::as_const(*res.ptr()).storage()[i]);
+        }
+    };
+    check(A.permute({2, 0, 1}));
+    check(A.transpose(0, 2));
+    check(A.slice(1, 4, 1).slice(3, 60, 2));
+    check(A.transpose(0, 1).slice(2, 3, 1));
+    check(A.to(st::DType::Int8).transpose(1, 2));
+
+    // large enough to be copied by several threads
+    st::Tensor B = st::Tensor::rand({1000, 600}, st::DType::Float32).transpose(0, 1);
+    st::Tensor C = B.contiguous();
+    for (st::index_t i = 0; i < 600; i += 7)
+        for (st::index_t j = 0; j < 1000; j += 13)
+            EXPECT_EQ((B[{i, j}]), (C[{i, j}]));
+}
+TEST(tensorOperatorTest, loopNest) {
+    st::Tensor A = st::Tensor::rand({2, 3, 4, 5});
+    auto flat = st::make_loop<1>(A.size(), {&A.stride()});
+    EXPECT_EQ(1, flat.n_dim());
+    EXPECT_EQ(120, flat.cols());
+    // the transposed view is walked with its unit stride innermost
+    st::Tensor B = A.permute({3, 0, 1, 2});
+    auto loop = st::make_loop<1>(B.size(), {&B.stride()});
+    EXPECT_EQ(1, loop.n_dim());
+    EXPECT_EQ(1, loop.stride[0].back());
+    st::Tensor C = A.transpose(1, 3).slice(0, 4, 2, 1);
+    auto sliced = st::make_loop<1>(C.size(), {&C.stride()});
+    EXPECT_EQ(2, sliced.n_dim());
+    EXPECT_EQ(2, sliced.stride[0].back());
+
+    // copies, reductions and compound assignment over strided views
+    st::Tensor D = B.to(st::DType::Float32);
+    st::Tensor E = C.sum(1), F = C.sum(2);
+    for (st::index_t i = 0; i < 5; ++i)
+        for (st::index_t j = 0; j < 2; ++j)
+            for (st::index_t k = 0; k < 3; ++k) {
+                EXPECT_FLOAT_EQ((float)(B[{i, j, k, 1}]), (D[{i, j, k, 1}]));
+                if (i < 2) {
+                    EXPECT_DOUBLE_EQ((C[{j, i, 0, k}] + C[{j, i, 1, k}] + C[{j, i, 2, k}] + C[{j, i, 3, k}]),
+                                     (F[{j, i, k}]));
+                }
+            }
+    EXPECT_DOUBLE_EQ((C[{1, 0, 2, 1}] + C[{1, 1, 2, 1}]), (E[{1, 2, 1}]));
+    st::data_t total = A.sum();
+    EXPECT_NEAR(total, B.sum(), 1e-9);
+    C *= 2;
+    EXPECT_NEAR(total + C.sum() / 2, A.sum(), 1e-9);
+}
+TEST(tensorOperatorTest, catStack) {
+    st::Tensor A = st::Tensor::rand({2, 3, 4});
+    st::Tensor B = st::Tensor::rand({2, 5, 4});
+    st::Tensor C = st::Tensor::rand({4, 1, 2}).transpose(0, 2); // strided
+    st::Tensor D = st::cat({A, B, C}, 1);
+    EXPECT_EQ(2, D.size(0));
+    EXPECT_EQ(9, D.size(1));
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t k = 0; k < 4; ++k) {
+            for (st::index_t j = 0; j < 3; ++j)
+                EXPECT_EQ((A[{i, j, k}]), (D[{i, j, k}]));
+            for (st::index_t j = 0; j < 5; ++j)
+                EXPECT_EQ((B[{i, j, k}]), (D[{i, j+3, k}]));
+            EXPECT_EQ((C[{i, 0, k}]), (D[{i, 8, k}]));
+        }
+
+    // into a preallocated, strided output of another dtype
+    st::Tensor E = st::Tensor::zeros({9, 4, 2}, st::DType::Float32);
+    st::Tensor out = E.permute({2, 0, 1});
+    st::cat({A, B, C}, 1, out);
+    EXPECT_FLOAT_EQ((float)(B[{1, 2, 3}]), (E[{5, 3, 1}]));
+
+    st::Tensor F = st::stack({A, A.slice(std::nullopt, std::nullopt, -1, 1)}, 3);
+    EXPECT_EQ(4, F.n_dim());
+    EXPECT_EQ(2, F.size(3));
+    EXPECT_EQ((A[{1, 2, 3}]), (F[{1, 2, 3, 0}]));
+    EXPECT_EQ((A[{0, 0, 3}]), (F[{0, 2, 3, 1}]));
+
+    // big enough for the copies to be spread over threads
+    st::Tensor G = st::Tensor::rand({300, 1000}, st::DType::Float32);
+    st::Tensor H = st::Tensor::rand({700, 1000}, st::DType::Float32);
+    st::Tensor I = st::Tensor::empty({2, 300, 1000}, st::DType::Float32);
+    st::Tensor J = st::cat({G, H});
+    st::stack({G, G}, 0, I);
+    for (st::index_t j = 0; j < 1000; j += 37) {
+        EXPECT_EQ((G[{299, j}]), (J[{299, j}]));
+        EXPECT_EQ((H[{0, j}]), (J[{300, j}]));
+        EXPECT_EQ((H[{699, j}]), (J[{999, j}]));
+        EXPECT_EQ((G[{123, j}]), (I[{1, 123, j}]));
+    }
+
+    EXPECT_THROW(st::cat({A, B}, 0), st::err::Error);
+    EXPECT_THROW(st::cat({A, A.to(st::DType::Float32)}, 0), st::err::Error);
+    EXPECT_THROW(st::stack({A, B}), st::err::Error);
+    EXPECT_THROW(st::cat({}), st::err::Error);
+}
+TEST(tensorOperatorTest, indexing) {
+    st::Tensor A = st::Tensor::rand({3, 4, 5});
+    int32_t idx_data[] = {2, 0, 2};
+    st::Tensor idx = st::Tensor::from_blob(idx_data, {3}, {}, st::DType::Int32);
+    st::Tensor B = st::index_select(A, 1, idx);
+    st::Tensor C = st::index_select(A.transpose(0, 2), 2, idx.to(st::DType::Int64));
+    st::Tensor D = st::index_select(A, 2, idx);
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            for (st::index_t k = 0; k < 4; ++k) {
+                st::index_t s = j == 1 ? 0 : 2;
+                EXPECT_EQ((A[{i, s, k}]), (B[{i, j, k}]));
+                EXPECT_EQ((A[{s, k, i}]), (C[{i, k, j}]));
+                EXPECT_EQ((A[{k % 3, i, s}]), (D[{k % 3, i, j}]));
+            }
+
+    // gather along dim 1 with an index narrower than A
+    std::vector<int64_t> index_data(2*3*5);
+    for (st::index_t i = 0; i < index_data.size(); ++i)
+        index_data[i] = (i * 7) % 4;
+    st::Tensor index = st::Tensor::from_blob(index_data.data(), {2, 3, 5}, {}, st::DType::Int64);
+    st::Tensor E = st::gather(A, 1, index);
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            for (st::index_t k = 0; k < 5; ++k)
+                EXPECT_EQ((A[{i, (st::index_t)index[{i, j, k}], k}]), (E[{i, j, k}]));
+
+    // scatter undoes gather where the index is a permutation
+    std::vector<int8_t> perm_data(3*4*5);
+    for (st::index_t i = 0; i < perm_data.size(); ++i)
+        perm_data[i] = (i / 5 + i % 5) % 4;
+    st::Tensor perm = st::Tensor::from_blob(perm_data.data(), {3, 4, 5}, {}, st::DType::Int8);
+    st::Tensor F = st::Tensor::zeros({3, 4, 5});
+    st::scatter(F, 1, perm, st::gather(A, 1, perm));
+    for (st::index_t i = 0; i < A.d_size(); ++i)
+        EXPECT_EQ(A.item(i), F.item(i));
+
+    // scatter_add sums repeated positions, in both modes
+    st::Tensor ones = st::Tensor::ones({400000});
+    std::vector<int32_t> bins_data(400000);
+    for (st::index_t i = 0; i < bins_data.size(); ++i)
+        bins_data[i] = i % 3;
+    st::Tensor bins = st::Tensor::from_blob(bins_data.data(), {400000}, {}, st::DType::Int32);
+    for (bool deterministic : {true, false}) {
+        st::Tensor G = st::Tensor::zeros({3});
+        st::scatter_add(G, 0, bins, ones, deterministic);
+        EXPECT_EQ(133334, (G[{0}]));
+        EXPECT_EQ(133333, (G[{2}]));
+    }
+    st::Tensor H = st::Tensor::zeros({2, 5});
+    st::scatter_add(H, 0, st::Tensor::zeros({4, 5}, st::DType::Int64), st::Tensor::ones({4, 5}));
+    EXPECT_EQ(4, (H[{0, 3}]));
+    EXPECT_EQ(0, (H[{1, 3}]));
+
+    EXPECT_THROW(st::index_select(A, 1, idx.to(st::DType::Float32)), st::err::Error);
+    EXPECT_THROW(st::index_select(A.slice(0, 2, 0), 0, idx), st::err::Error);
+    EXPECT_THROW(st::gather(A, 1, st::Tensor::zeros({4, 4, 5}, st::DType::Int32)), st::err::Error);
+
+    // an empty index selects nothing
+    st::Tensor none = st::Tensor::empty({3, 4, 0}, st::DType::Int64);
+    EXPECT_EQ(st::Shape({3, 4, 0}), st::gather(A, 2, none).size());
+    st::Tensor Z = A.to(A.dtype());
+    st::scatter_add(Z, 2, none, A);
+    EXPECT_EQ((A[{1, 1, 1}]), (Z[{1, 1, 1}]));
+}
 TEST(tensorOperatorTest, sumInOneDim) {
     st::Tensor A = st::Tensor::rand({2, 3, 4});
     st::Tensor B = A.sum(1);
@@ -226,7 +1096,104 @@ TEST(tensorBroadcastTest, broadcast) {
     std::cout << B << std::endl;
     std::cout << C << std::endl;
 }
+TEST(tensorBroadcastTest, expandSqueeze) {
+    st::Tensor A = st::Tensor::rand({3, 1});
+    st::Tensor B = A.expand({2, 3, 4});
+    EXPECT_EQ(A.ptr()->storage().raw(), B.ptr()->storage().raw());
+    EXPECT_EQ(0, B.ptr()->stride()[0]);
+    EXPECT_EQ(0, B.ptr()->stride()[2]);
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            for (st::index_t k = 0; k < 4; ++k)
+                EXPECT_EQ((A[{j, 0}]), (B[{i, j, k}]));
+    st::Tensor C = st::Tensor::rand({3, 4}) + A.broadcast_to({3, 4});
+    EXPECT_EQ(2, C.n_dim());
+    EXPECT_THROW((void)A.expand({2, 4}), st::err::Error);
+    EXPECT_THROW((void)A.expand({1}), st::err::Error);
 
+    st::Tensor D = st::Tensor::rand({2, 3, 4}).slice(1, 1);
+    st::Tensor E = D.squeeze(1);
+    EXPECT_EQ(2, E.n_dim());
+    EXPECT_EQ(4, E.size(1));
+    EXPECT_EQ(3, D.squeeze(0).n_dim());
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t k = 0; k < 4; ++k)
+            EXPECT_EQ((D[{i, 0, k}]), (E[{i, k}]));
+    st::Tensor F = E.unsqueeze(2).unsqueeze(0);
+    EXPECT_EQ(4, F.n_dim());
+    EXPECT_EQ(1, F.size(0));
+    EXPECT_EQ(1, F.size(3));
+    EXPECT_EQ((E[{1, 2}]), (F[{0, 1, 2, 0}]));
+    EXPECT_EQ(2, F.squeeze().n_dim());
+    EXPECT_EQ(1, st::Tensor({1, 1}).squeeze().n_dim());
+    EXPECT_THROW((void)E.unsqueeze(3), st::err::Error);
+}
+
+TEST(tensorBroadcastTest, whereMasks) {
+    st::Tensor A = st::Tensor::rand({3, 4});
+    st::Tensor B = st::Tensor::rand({4});
+    st::Tensor mask = A > B;
+    EXPECT_EQ(st::DType::UInt8, mask.dtype());
+    st::Tensor C = st::where(mask, A, B);
+    st::Tensor D = st::where(A <= 0.5, 0.0, A * B); // fused: no mask is materialized
+    st::Tensor E = st::masked_fill(A, st::eq(A, A.slice(1, 2, 0)), -1.0);
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 4; ++j) {
+            EXPECT_EQ((A[{i, j}] > B[{j}]) ? 1 : 0, (mask[{i, j}]));
+            EXPECT_EQ(std::max((A[{i, j}]), (B[{j}])), (C[{i, j}]));
+            EXPECT_EQ(((A[{i, j}] <= 0.5) ? 0.0 : A[{i, j}] * B[{j}]), (D[{i, j}]));
+            EXPECT_EQ(i == 1 ? -1.0 : (A[{i, j}]), (E[{i, j}]));
+        }
+
+    // clipping in place, on a strided view, in one pass
+    st::Tensor F = st::Tensor::randn({4, 3}, st::DType::Float32);
+    st::Tensor G = F.clone();
+    st::Tensor H = F.transpose(0, 1);
+    H = st::where(H > 1.0, 1.0, st::where(H < -1.0, -1.0, H));
+    for (st::index_t i = 0; i < 4; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            EXPECT_EQ(std::clamp<st::data_t>((G[{i, j}]), -1.0, 1.0), (H[{j, i}]));
+
+    st::Tensor I = st::Tensor::ones({2, 2}, st::DType::Int32);
+    EXPECT_EQ(st::DType::Int32, st::masked_fill(I, st::ne(I, I), 0.5).self().dtype());
+    EXPECT_THROW(st::Tensor(st::where(mask, A, st::Tensor::rand({2}))), st::err::Error);
+
+    // blocks with an all-true, an all-false and a mixed mask
+    st::Tensor J = st::Tensor::rand({1000});
+    st::Tensor K = st::Tensor::zeros({1000});
+    for (st::index_t i = 0; i < 256; ++i)
+        K[{i}] = 1;
+    for (st::index_t i = 512; i < 1000; i += 3)
+        K[{i}] = 1;
+    st::Tensor L = st::where(K, 2 * J, st::exp(J));
+    for (st::index_t i = 0; i < 1000; ++i)
+        EXPECT_DOUBLE_EQ((K[{i}]) != 0 ? 2 * (J[{i}]) : std::exp((J[{i}])), (L[{i}]));
+}
+
+TEST(tensorOperatorTest, accessor) {
+    st::Tensor A = st::Tensor::rand({2, 3, 4});
+    st::Tensor B = A.transpose(0, 2);
+    const st::Tensor& C = B;
+    auto a = A.accessor<double, 3>();
+    auto c = C.accessor<double, 3>();
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            for (st::index_t k = 0; k < 4; ++k) {
+                EXPECT_EQ((A[{i, j, k}]), a(i, j, k));
+                EXPECT_EQ((A[{i, j, k}]), c(k, j, i));
+                EXPECT_EQ(a(i, j, k), a[i][j][k]);
+            }
+    a(1, 2, 3) = 5;
+    EXPECT_EQ((A[{1, 2, 3}]), 5);
+    EXPECT_EQ(4, c.size(0));
+    // a reversed view has a negative stride
+    st::Tensor R = A.slice(std::nullopt, std::nullopt, -1, 2);
+    auto r = std::as_const(R).accessor<double, 3>();
+    EXPECT_EQ((A[{1, 2, 0}]), r(1, 2, 3));
+    EXPECT_EQ((A[{1, 1, 2}]), r[1][1][1]);
+    EXPECT_THROW(((void)A.accessor<double, 2>()), st::err::Error);
+    EXPECT_THROW(((void)A.accessor<float, 3>()), st::err::Error);
+}
 TEST(tensorIteratorTest, iterator) {
     st::Tensor A = st::Tensor::rand({2, 3, 4});
     st::Tensor::iterator it = A.begin();
@@ -249,6 +1216,37 @@ TEST(tensorIteratorTest, constIterator) {
             }
     EXPECT_EQ(it, A.end());
 }
+TEST(tensorIteratorTest, stridedIterator) {
+    static_assert(std::random_access_iterator<st::Tensor::iterator>);
+    static_assert(std::random_access_iterator<st::Tensor::const_iterator>);
+    static_assert(std::random_access_iterator<st::StridedIterator<float>>);
+    static_assert(std::ranges::contiguous_range<decltype(std::declval<st::Tensor&>().values<double>())>);
+
+    st::Tensor A = st::Tensor::rand({2, 3, 4});
+    st::Tensor B = A.transpose(0, 2).slice({}, {}, -1, 1);
+    std::vector<double> expect;
+    for (st::index_t i = 0; i < 4; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            for (st::index_t k = 0; k < 2; ++k)
+                expect.push_back(A[{k, 2-j, i}]);
+    EXPECT_TRUE(std::ranges::equal(B, expect));
+    EXPECT_TRUE(std::ranges::equal(B.elements<double>(), expect));
+    EXPECT_TRUE(std::ranges::equal(std::views::reverse(B.elements<double>()), std::views::reverse(expect)));
+    auto it = B.begin() + 17;
+    EXPECT_EQ(*it, expect[17]);
+    EXPECT_EQ(it[-10], expect[7]);
+    EXPECT_EQ(B.end() - it, 7);
+
+    std::ranges::fill(B.elements<double>(), 1);
+    EXPECT_EQ(A.sum(), 24);
+    std::vector<float> data{3, 1, 2, 0};
+    st::Tensor C = st::Tensor::from_blob(data.data(), {4}, {}, st::DType::Float32).to(st::DType::Float32);
+    std::ranges::sort(C.values<float>());
+    EXPECT_EQ(C[{0}], 0);
+    EXPECT_EQ(C[{3}], 3);
+    EXPECT_THROW((void)B.values<double>(), st::err::Error);
+    EXPECT_THROW((void)C.values<double>(), st::err::Error);
+}
 
 
 TEST(tensorExpLazyCaculationTest, lazyEvaluation) {
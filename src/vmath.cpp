@@ -0,0 +1,388 @@
+#include "vmath.h"
+#include "cpu.h"
+
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// The reductions below rely on products being rounded on their own, which
+// contracting them into FMAs in the AVX2 and AVX-512 builds would break.
+#pragma GCC optimize("fp-contract=off")
+
+namespace st {
+    namespace vmath {
+        namespace {
+            // The kernels are written once over a lane type V, which is either a
+            // plain data_t or a GCC vector of data_t. The array functions are
+            // built for 2, 4 and 8 lanes, the wider ones with target attributes,
+            // and everything they call is inlined into them so that it is
+            // compiled for their instruction set.
+#define VMATH_INLINE [[gnu::always_inline]] inline
+
+            template<index_t L>
+            struct Lanes {
+                typedef data_t vec __attribute__((vector_size(L*sizeof(data_t))));
+            };
+            // the vector of T as wide as the vector V
+            template<typename T, typename V>
+            struct Rebind {
+                typedef T type __attribute__((vector_size(sizeof(V))));
+            };
+            template<typename V>
+            concept Vector = !std::is_arithmetic_v<V>;
+
+            std::atomic<Precision> global_precision{Precision::Accurate};
+
+            VMATH_INLINE std::int64_t as_int(data_t x) { return std::bit_cast<std::int64_t>(x); }
+            template<Vector V>
+            VMATH_INLINE auto as_int(V x) { return (typename Rebind<std::int64_t, V>::type)x; }
+            VMATH_INLINE data_t as_float(std::int64_t x) { return std::bit_cast<data_t>(x); }
+            template<Vector I>
+            VMATH_INLINE auto as_float(I x) { return (typename Rebind<data_t, I>::type)x; }
+            VMATH_INLINE std::int64_t to_int(data_t x) { return (std::int64_t)x; }
+            template<Vector V>
+            VMATH_INLINE auto to_int(V x) { return __builtin_convertvector(x, typename Rebind<std::int64_t, V>::type); }
+            VMATH_INLINE data_t to_float(std::int64_t x) { return (data_t)x; }
+            template<Vector I>
+            VMATH_INLINE auto to_float(I x) { return __builtin_convertvector(x, typename Rebind<data_t, I>::type); }
+            VMATH_INLINE bool any(bool mask) { return mask; }
+            template<Vector I>
+            VMATH_INLINE bool any(I mask) {
+                for (index_t i = 0; i < sizeof(I) / sizeof(mask[0]); ++i)
+                    if (mask[i]) return true;
+                return false;
+            }
+
+            template<typename V>
+            VMATH_INLINE V splat(data_t x) { return V{} + x; }
+
+            template<typename V>
+            VMATH_INLINE V abs(V x) { return as_float(as_int(x) & 0x7fffffffffffffff); }
+
+            template<typename V>
+            VMATH_INLINE V copysign(V x, V sign) {
+                return as_float((as_int(x) & 0x7fffffffffffffff) | (as_int(sign) & (-0x7fffffffffffffff-1)));
+            }
+
+            // round to nearest integer, valid for |x| < 2^51
+            template<typename V>
+            VMATH_INLINE V round(V x) {
+                const data_t shifter = 6755399441055744.0; // 1.5*2^52
+                return (x + shifter) - shifter;
+            }
+
+            // 2^k for k in [-1022, 1023]
+            template<typename V, typename I>
+            VMATH_INLINE V exp2i(I k) { return as_float((k + 1023) << 52); }
+
+            // ---- sin / cos / tan ----
+            const data_t kTwoOverPi = 6.36619772367581382433e-01;
+            const data_t kPio2_1  = 1.57079632673412561417e+00; // first 33 bits of pi/2
+            const data_t kPio2_1t = 6.07710050650619224932e-11; // pi/2 - kPio2_1
+            const data_t kPio2_2  = 6.07710050630396597660e-11; // second 33 bits of pi/2
+            const data_t kPio2_3  = 2.02226624871116645580e-21; // third 33 bits of pi/2
+            const data_t kPio2_3t = 8.47842766036889956997e-32; // pi/2 - kPio2_1 - kPio2_2 - kPio2_3
+            const data_t kReduceMax = 823549.6; // 2^19*pi/2, keeps j*kPio2_* exact
+
+            const data_t S1 = -1.66666666666666324348e-01;
+            const data_t S2 =  8.33333333332248946124e-03;
+            const data_t S3 = -1.98412698298579493134e-04;
+            const data_t S4 =  2.75573137070700676789e-06;
+            const data_t S5 = -2.50507602534068634195e-08;
+            const data_t S6 =  1.58969099521155010221e-10;
+            const data_t C1 =  4.16666666666666019037e-02;
+            const data_t C2 = -1.38888888888741095749e-03;
+            const data_t C3 =  2.48015872894767294178e-05;
+            const data_t C4 = -2.75573143513906633035e-07;
+            const data_t C5 =  2.08757232129817482790e-09;
+            const data_t C6 = -1.13596475577881948265e-11;
+
+            // x = j*pi/2 + hi + lo with |hi| <= pi/4
+            template<typename V, bool Fast>
+            VMATH_INLINE V reduce_pio2(V x, V& hi, V& lo) {
+                V j = round(x*kTwoOverPi);
+                if constexpr (Fast) {
+                    hi = (x - j*kPio2_1) - j*kPio2_1t;
+                    lo = splat<V>(0);
+                } else {
+                    // every product is exact, the sums are carried as double-double
+                    V r1 = x - j*kPio2_1;
+                    V p2 = j*kPio2_2, p3 = j*kPio2_3;
+                    V r2 = r1 - p2;
+                    V b2 = r2 - r1;
+                    V e2 = (r1 - (r2 - b2)) - (p2 + b2);
+                    V r3 = r2 - p3;
+                    V b3 = r3 - r2;
+                    V e3 = (r2 - (r3 - b3)) - (p3 + b3);
+                    V tail = (e2 + e3) - j*kPio2_3t;
+                    hi = r3 + tail;
+                    lo = tail - (hi - r3);
+                }
+                return j;
+            }
+
+            // sin(x+y) and cos(x+y) on [-pi/4, pi/4], y is the tail of x
+            template<typename V, bool Fast>
+            VMATH_INLINE V kernel_sin(V x, V y) {
+                V z = x*x;
+                V v = z*x;
+                V r = S2 + z*(S3 + z*(S4 + z*(S5 + z*S6)));
+                if constexpr (Fast) return x + v*(S1 + z*r);
+                else return x - ((z*(0.5*y - v*r) - y) - v*S1);
+            }
+
+            template<typename V, bool Fast>
+            VMATH_INLINE V kernel_cos(V x, V y) {
+                V z = x*x;
+                V r = z*(C1 + z*(C2 + z*(C3 + z*(C4 + z*(C5 + z*C6)))));
+                V hz = 0.5*z;
+                V w = 1.0 - hz;
+                if constexpr (Fast) return w + (((1.0 - w) - hz) + z*r);
+                else return w + (((1.0 - w) - hz) + (z*r - x*y));
+            }
+
+            template<typename V, bool Fast>
+            VMATH_INLINE V sin_kernel(V x) {
+                V hi, lo;
+                auto q = to_int(reduce_pio2<V, Fast>(x, hi, lo));
+                V s = kernel_sin<V, Fast>(hi, lo);
+                V c = kernel_cos<V, Fast>(hi, lo);
+                V res = (q & 1) != 0 ? c : s;
+                res = (q & 2) != 0 ? -res : res;
+                return x == 0.0 ? x : res; // keeps the sign of zero
+            }
+
+            template<typename V, bool Fast>
+            VMATH_INLINE V cos_kernel(V x) {
+                V hi, lo;
+                auto q = to_int(reduce_pio2<V, Fast>(x, hi, lo));
+                V s = kernel_sin<V, Fast>(hi, lo);
+                V c = kernel_cos<V, Fast>(hi, lo);
+                V res = (q & 1) != 0 ? s : c;
+                return ((q + 1) & 2) != 0 ? -res : res;
+            }
+
+            template<typename V, bool Fast>
+            VMATH_INLINE V tan_kernel(V x) {
+                V hi, lo;
+                auto q = to_int(reduce_pio2<V, Fast>(x, hi, lo));
+                V s = kernel_sin<V, Fast>(hi, lo);
+                V c = kernel_cos<V, Fast>(hi, lo);
+                V res = (q & 1) != 0 ? -c/s : s/c;
+                return x == 0.0 ? x : res;
+            }
+
+            // ---- exp / expm1 ----
+            const data_t kInvLn2 = 1.44269504088896338700e+00;
+            const data_t kLn2Hi = 6.93147180369123816490e-01;
+            const data_t kLn2Lo = 1.90821492927058770002e-10;
+            const data_t kExpMax = 709.782712893383973096;
+            const data_t kExpMin = -745.13321910194110842;
+
+            const data_t P1 =  1.66666666666666019037e-01;
+            const data_t P2 = -2.77777777770155933842e-03;
+            const data_t P3 =  6.61375632143793436117e-05;
+            const data_t P4 = -1.65339022054652515390e-06;
+            const data_t P5 =  4.13813679705723846039e-08;
+
+            template<typename V, bool Fast>
+            VMATH_INLINE V exp_kernel(V x) {
+                V xc = x;
+                if constexpr (!Fast) {
+                    xc = xc > 710.0 ? splat<V>(710) : xc;
+                    xc = xc < -746.0 ? splat<V>(-746) : xc;
+                    xc = xc != xc ? splat<V>(0) : xc;
+                }
+                V kf = round(xc*kInvLn2);
+                V hi = xc - kf*kLn2Hi;
+                V lo = kf*kLn2Lo;
+                V r = hi - lo;
+                V t = r*r;
+                V c = r - t*(P1 + t*(P2 + t*(P3 + t*(P4 + t*P5))));
+                V y = 1.0 - ((lo - (r*c)/(2.0 - c)) - hi);
+                auto k = to_int(kf);
+                if constexpr (Fast) {
+                    return y*exp2i<V>(k);
+                } else {
+                    // split the scale so that both halves are normal numbers
+                    auto k1 = k >> 1;
+                    V res = y*exp2i<V>(k1)*exp2i<V>(k - k1);
+                    res = x > kExpMax ? splat<V>(HUGE_VAL) : res;
+                    res = x < kExpMin ? splat<V>(0) : res;
+                    return x != x ? x : res;
+                }
+            }
+
+            // e^x-1 without cancellation near zero, |x| <= 64*ln2
+            template<typename V>
+            VMATH_INLINE V expm1_kernel(V x) {
+                V kf = round(x*kInvLn2);
+                V r = (x - kf*kLn2Hi) - kf*kLn2Lo;
+                V p = r + r*r*(1.0/2 + r*(1.0/6 + r*(1.0/24 + r*(1.0/120 + r*(1.0/720
+                        + r*(1.0/5040 + r*(1.0/40320 + r*(1.0/362880 + r*(1.0/3628800
+                        + r*(1.0/39916800 + r*(1.0/479001600 + r*(1.0/6227020800))))))))))));
+                V scale = exp2i<V>(to_int(kf));
+                return scale*p + (scale - 1.0);
+            }
+
+            // ---- log ----
+            const data_t Lg1 = 6.666666666666735130e-01;
+            const data_t Lg2 = 3.999999999940941908e-01;
+            const data_t Lg3 = 2.857142874366239149e-01;
+            const data_t Lg4 = 2.222219843214978396e-01;
+            const data_t Lg5 = 1.818357216161805012e-01;
+            const data_t Lg6 = 1.531383769920937332e-01;
+            const data_t Lg7 = 1.479819860511658591e-01;
+
+            template<typename V, bool Fast>
+            VMATH_INLINE V log_kernel(V x) {
+                V xs = x;
+                V kf = splat<V>(0);
+                if constexpr (!Fast) {
+                    // bring subnormals into the normal range first
+                    auto sub = x < 2.2250738585072014e-308;
+                    xs = sub ? x*18014398509481984.0 : x; // 2^54
+                    kf = sub ? splat<V>(-54) : kf;
+                }
+                // x = 2^k*m with m in [sqrt(2)/2, sqrt(2))
+                auto ix = as_int(xs);
+                auto hx = (ix >> 32) + (0x3ff00000 - 0x3fe6a09e);
+                kf += to_float((hx >> 20) - 0x3ff);
+                hx = (hx & 0x000fffff) + 0x3fe6a09e;
+                V m = as_float((hx << 32) | (ix & 0xffffffff));
+                V f = m - 1.0;
+                V hfsq = 0.5*f*f;
+                V s = f/(2.0 + f);
+                V z = s*s;
+                V w = z*z;
+                V t1 = w*(Lg2 + w*(Lg4 + w*Lg6));
+                V t2 = z*(Lg1 + w*(Lg3 + w*(Lg5 + w*Lg7)));
+                V res = s*(hfsq + (t1 + t2)) + kf*kLn2Lo - hfsq + f + kf*kLn2Hi;
+                if constexpr (!Fast) {
+                    res = x == HUGE_VAL ? x : res;
+                    res = x == 0.0 ? splat<V>(-HUGE_VAL) : res;
+                    res = (x < 0.0) | (x != x) ? splat<V>(NAN) : res;
+                }
+                return res;
+            }
+
+            // ---- tanh / sigmoid ----
+            template<typename V, bool Fast>
+            VMATH_INLINE V tanh_kernel(V x) {
+                V ax = abs(x);
+                if constexpr (!Fast) ax = (ax > 22.0) | (ax != ax) ? splat<V>(22) : ax;
+                V t = expm1_kernel(2.0*ax);
+                V res = copysign(t/(t + 2.0), x);
+                if constexpr (!Fast) return x != x ? x : res;
+                else return res;
+            }
+
+            template<typename V, bool Fast>
+            VMATH_INLINE V sigmoid_kernel(V x) {
+                if constexpr (Fast) {
+                    return 1.0/(1.0 + exp_kernel<V, true>(-x));
+                } else {
+                    V e = exp_kernel<V, false>(-abs(x));
+                    V res = x < 0.0 ? e/(1.0 + e) : 1.0/(1.0 + e);
+                    return x != x ? x : res;
+                }
+            }
+
+            // run a kernel over an array, lanes the kernel cannot handle go to libm
+            template<typename V, V (*Kernel)(V), data_t (*Tail)(data_t), data_t (*Fallback)(data_t)>
+            VMATH_INLINE void map(const data_t* src, data_t* dst, index_t n, data_t limit) {
+                constexpr index_t lanes = sizeof(V) / sizeof(data_t);
+                index_t i = 0;
+                for (; i+lanes <= n; i += lanes) {
+                    V x;
+                    std::memcpy(&x, src+i, sizeof(V));
+                    V y = Kernel(x);
+                    std::memcpy(dst+i, &y, sizeof(V));
+                    if (Fallback != nullptr && any((abs(x) > limit) | (x != x))) {
+                        for (index_t j = 0; j < lanes; ++j)
+                            if (!(std::fabs(x[j]) <= limit)) dst[i+j] = Fallback(x[j]);
+                    }
+                }
+                for (; i < n; ++i) dst[i] = Tail(src[i]);
+            }
+
+            data_t libm_sin(data_t x) { return std::sin(x); }
+            data_t libm_cos(data_t x) { return std::cos(x); }
+            data_t libm_tan(data_t x) { return std::tan(x); }
+            bool is_fast() { return global_precision.load(std::memory_order_relaxed) == Precision::Fast; }
+        }
+
+        void set_precision(Precision precision) { global_precision.store(precision, std::memory_order_relaxed); }
+        Precision precision() { return global_precision.load(std::memory_order_relaxed); }
+
+        data_t sin(data_t x) {
+            if (is_fast()) return sin_kernel<data_t, true>(x);
+            if (!(std::fabs(x) <= kReduceMax)) return std::sin(x);
+            return sin_kernel<data_t, false>(x);
+        }
+        data_t cos(data_t x) {
+            if (is_fast()) return cos_kernel<data_t, true>(x);
+            if (!(std::fabs(x) <= kReduceMax)) return std::cos(x);
+            return cos_kernel<data_t, false>(x);
+        }
+        data_t tan(data_t x) {
+            if (is_fast()) return tan_kernel<data_t, true>(x);
+            if (!(std::fabs(x) <= kReduceMax)) return std::tan(x);
+            return tan_kernel<data_t, false>(x);
+        }
+        data_t exp(data_t x) {
+            return is_fast() ? exp_kernel<data_t, true>(x) : exp_kernel<data_t, false>(x);
+        }
+        data_t log(data_t x) {
+            return is_fast() ? log_kernel<data_t, true>(x) : log_kernel<data_t, false>(x);
+        }
+        data_t tanh(data_t x) {
+            return is_fast() ? tanh_kernel<data_t, true>(x) : tanh_kernel<data_t, false>(x);
+        }
+        data_t sigmoid(data_t x) {
+            return is_fast() ? sigmoid_kernel<data_t, true>(x) : sigmoid_kernel<data_t, false>(x);
+        }
+
+#ifdef ST_X86_DISPATCH
+#define VMATH_WIDE(name) \
+        namespace { \
+            __attribute__((target("avx2,fma"))) \
+            void name##_avx2(const data_t* src, data_t* dst, index_t n) { name##_lanes<Lanes<4>::vec>(src, dst, n); } \
+            __attribute__((target("avx512f,avx512bw"))) \
+            void name##_avx512(const data_t* src, data_t* dst, index_t n) { name##_lanes<Lanes<8>::vec>(src, dst, n); } \
+        } \
+        void name(const data_t* src, data_t* dst, index_t n) { \
+            cpu::Isa isa = cpu::isa(); \
+            if (isa >= cpu::Isa::AVX512) name##_avx512(src, dst, n); \
+            else if (isa >= cpu::Isa::AVX2) name##_avx2(src, dst, n); \
+            else name##_lanes<Lanes<2>::vec>(src, dst, n); \
+        }
+#else
+#define VMATH_WIDE(name) \
+        void name(const data_t* src, data_t* dst, index_t n) { name##_lanes<Lanes<2>::vec>(src, dst, n); }
+#endif
+#define VMATH_MAP(name, fallback, limit) \
+        namespace { \
+            template<typename V> \
+            VMATH_INLINE void name##_lanes(const data_t* src, data_t* dst, index_t n) { \
+                if (is_fast()) \
+                    map<V, name##_kernel<V, true>, name##_kernel<data_t, true>, nullptr>(src, dst, n, 0); \
+                else \
+                    map<V, name##_kernel<V, false>, name, fallback>(src, dst, n, limit); \
+            } \
+        } \
+        VMATH_WIDE(name)
+        VMATH_MAP(sin, libm_sin, kReduceMax)
+        VMATH_MAP(cos, libm_cos, kReduceMax)
+        VMATH_MAP(tan, libm_tan, kReduceMax)
+        VMATH_MAP(exp, nullptr, 0)
+        VMATH_MAP(log, nullptr, 0)
+        VMATH_MAP(tanh, nullptr, 0)
+        VMATH_MAP(sigmoid, nullptr, 0)
+#undef VMATH_MAP
+#undef VMATH_WIDE
+    } // vmath
+} // st